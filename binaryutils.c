@@ -13,16 +13,28 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "binaryutils.h"
+#include "distancetransform.h"
+#include "parallel.h"
+
 int morphclose(unsigned char *binary, int width, int height, unsigned char *sel, int swidth, int sheight);
 int morphopen(unsigned char *binary, int width, int height, unsigned char *sel, int swidth, int sheight);
+void setmorphdiskradius(int radius);
 int dilate(unsigned char *binary, int width, int height, unsigned char *sel, int swidth, int sheight);
 int erode(unsigned char *binary, int width, int height, unsigned char *sel, int swidth, int sheight);
 int *labelconnected(unsigned char *binary, int width, int height, int connex, int *Nout);
+int *labelconnected_mt(unsigned char *binary, int width, int height, int connex, int *Nout, int Nthreads);
+int *labelconnectedstats(unsigned char *binary, int width, int height, int connex, int *Nout, COMPONENTSTATS **stats);
 int eulernumber(unsigned char *binary, int width, int height);
 int getbiggestobject(unsigned char *binary, int width, int height, int connex);
 int branchpoints(unsigned char *binary, int width, int height, int **xout, int **yout);
 int ends(unsigned char *binary, int width, int height, int **xout, int **yout);
 unsigned char *perimeter(unsigned char *binary, int width, int height);
+void neighbourcodes3x3(unsigned char *binary, int width, int height, int y, unsigned char border, unsigned short *codes);
+unsigned char *binary_applylut3x3(unsigned char *binary, int width, int height, unsigned char *lut, unsigned char border);
+void compilehitormiss(unsigned char *lut, unsigned char *fg, unsigned char *bg, int Ntemplates);
+unsigned char *hitormiss(unsigned char *binary, int width, int height, unsigned char *fg, unsigned char *bg, int Ntemplates);
+int hitormiss_multi(unsigned char *binary, int width, int height, unsigned char **luts, int Nsets, unsigned char **out);
 void invertbinary(unsigned char *binary, int width, int height);
 unsigned char *copybinary(unsigned char *binary, int width, int height);
 unsigned char *subbinary(unsigned char *binary, int width, int height, int x, int y, int swidth, int sheight);
@@ -33,8 +45,45 @@ void *compressbinary(unsigned char *binary, int width, int height, int *clen);
 unsigned char *decompressbinary(unsigned char *comp, int *width, int *height);
 int getcontours(unsigned char *binary, int width, int height, double ***x, double ***y, int **Nret);
 
-static int mem_count(unsigned char *pixels, int N, int value);
-static void get3x3(unsigned char *out, unsigned char *binary, int width, int height, int x, int y, unsigned char border);
+static int isdisk(unsigned char *sel, int swidth, int sheight);
+static int decomposese(unsigned char *sel, int swidth, int sheight, int **rects);
+static int morphinplace(unsigned char *binary, int width, int height, unsigned char *sel, int swidth, int sheight, int dilation);
+static void morphrectsrow(unsigned char *binary, int width, int height, int y, unsigned char *ring, int Nring,
+                          int *rects, int Nrects, int *counts, int dilation, unsigned char *hrow, unsigned char *g, unsigned char *h);
+static void morphdirectrow(unsigned char *binary, int width, int height, int y, unsigned char *ring, int Nring,
+                           unsigned char *sel, int swidth, int sheight, unsigned char **rows, int dilation);
+static void vhgw(unsigned char *in, unsigned char *out, int N, int a, int b, int dilation, unsigned char *g, unsigned char *h);
+static int labelblocks8(unsigned char *binary, int width, int height, int *labels, int *parents, int base);
+static int labelruns4(unsigned char *binary, int width, int height, int *labels, int *parents, int base);
+static int *labelcomponents(unsigned char *binary, int width, int height, int connex, int *Nout, COMPONENTSTATS **stats);
+static int relabelraster(int *labels, int N, int *parents, int Nlabels);
+static int relabelstats(unsigned char *binary, int width, int height, int *labels, int *parents, int Nlabels,
+                        COMPONENTSTATS **stats);
+static void labelband(void *ptr, int band);
+static void renumberband(void *ptr, int band);
+static int findroot(int *parents, int label);
+static int mergelabels(int *parents, int a, int b);
+static int lutpoints(unsigned char *binary, int width, int height, unsigned char *lut, int **xout, int **yout);
+static int bitcount3x3(int code);
+static int crossings3x3(int code);
+
+/* disks above this radius are opened and closed via the distance transform */
+static int diskradius = 10;
+
+typedef struct
+{
+  unsigned char *binary;  /* the image */
+  int width;              /* image width */
+  int height;             /* image height */
+  int connex;             /* 4 or 8 connectivity */
+  int bandheight;         /* rows per band, even */
+  int perband;            /* provisional labels reserved per band */
+  int *labels;            /* the labels */
+  int *parents;           /* union-find forest, indexed by label */
+  int *roots;             /* band's local roots in order of first appearance */
+  int *numbers;           /* final component number of each local root */
+  int *Nroots;            /* number of local roots per band */
+} LABELBANDS;
 
 /**
    Morphological close operation.
@@ -51,6 +100,16 @@ static void get3x3(unsigned char *out, unsigned char *binary, int width, int hei
 int morphclose(unsigned char *binary, int width, int height, unsigned char *sel, int swidth, int sheight)
 {
   int err;
+  int radius;
+
+  radius = isdisk(sel, swidth, sheight);
+  if(radius > diskradius)
+  {
+    err = dilate_disk(binary, width, height, radius);
+    if(err)
+      return err;
+    return erode_disk(binary, width, height, radius);
+  }
 
   err = dilate(binary, width, height, sel, swidth, sheight);
   if(err)
@@ -76,6 +135,16 @@ Morphological open operation.
 int morphopen(unsigned char *binary, int width, int height, unsigned char *sel, int swidth, int sheight)
 {
   int err;
+  int radius;
+
+  radius = isdisk(sel, swidth, sheight);
+  if(radius > diskradius)
+  {
+    err = erode_disk(binary, width, height, radius);
+    if(err)
+      return err;
+    return dilate_disk(binary, width, height, radius);
+  }
 
   err = erode(binary, width, height, sel, swidth, sheight);
   if(err)
@@ -86,6 +155,20 @@ int morphopen(unsigned char *binary, int width, int height, unsigned char *sel,
   return 0;
 }
 
+/**
+  Set the radius above which morphopen() and morphclose() treat a
+  disk structuring element specially.
+
+  @param radius - the threshold radius
+  @note Disks as made by sedisk() larger than this are applied by
+    thresholding the Euclidean distance transform, which costs the same
+    whatever the radius. The result is the same either way. The default is 10.
+*/
+void setmorphdiskradius(int radius)
+{
+  diskradius = radius;
+}
+
 /**
 Dilate operation.
 
@@ -100,43 +183,7 @@ Dilate operation.
 */
 int dilate(unsigned char *binary, int width, int height, unsigned char *sel, int swidth, int sheight)
 {
-	int x, y, sx, sy, ix, iy;
-	unsigned char *answer;
-    int i;
-    int bit;
-
-	answer = malloc(width * height);
-	if(!answer)
-		return -1;
-     
-	for(i=0;i<width*height;i++)
-      answer[i] = 0;
-
-	for(y=0;y<height;y++)
-      for(x=0;x<width;x++)
-	  {
-		  for(sy=0;sy<sheight;sy++)
-		    for(sx =0; sx < swidth; sx++)
-			{
-		      ix = x + sx - swidth/2;
-			  iy = y + sy - sheight/2;
-			  if(ix < 0 || ix >= width || iy < 0 || iy >= height)
-				  bit = 0;
-			  else
-		        bit = binary[iy * width + ix];
-			  if(bit == 1 && sel[sy*swidth+sx] == 1)
-			  {
-                 answer[y*width+x] = 1;
-			  }
-			}
-	  }
-   for(i=0;i<width*height;i++)
-     binary[i] = answer[i];
-   free(answer);
-
-   return 0;
-
-
+  return morphinplace(binary, width, height, sel, swidth, sheight, 1);
 }
 
 /**
@@ -153,42 +200,7 @@ Erode operation.
 */
 int erode(unsigned char *binary, int width, int height, unsigned char *sel, int swidth, int sheight)
 {
-	int x, y, sx, sy, ix, iy;
-	unsigned char *answer;
-    int i;
-	int bit;
-
-	answer = malloc(width * height);
-	if(!answer)
-		return -1;
-	for(i=0;i<width*height;i++)
-      answer[i] =1;
-
-
-	for(y=0;y<height;y++)
-      for(x=0;x<width;x++)
-	  {
-		  for(sy=0;sy<sheight;sy++)
-		    for(sx =0; sx < swidth; sx++)
-			{
-		      ix = x + sx - swidth/2;
-			  iy = y + sy - sheight/2;
-			  if(ix < 0 || ix >= width || iy < 0 || iy >= height)
-				  bit = 0;
-			  else
-		        bit = binary[iy * width + ix];
-			  if(bit == 0 && sel[sy*swidth+sx] == 1)
-			  {
-                 answer[y*width+x] = 0;
-			     break;
-			  }
-			}
-	  }
-   for(i=0;i<width*height;i++)
-     binary[i] = answer[i];
-   free(answer);
-
-   return 0;
+  return morphinplace(binary, width, height, sel, swidth, sheight, 0);
 }
 
 /**
@@ -199,134 +211,141 @@ int erode(unsigned char *binary, int width, int height, unsigned char *sel, int
   @param      connex - 4 or 8 connectivity
   @param[out] Nout - number of components found
   returns  Width * height array of labels for connected components.
+  \note Components are numbered 1 to *Nout - 1 in raster order of their
+    first pixel, background is 0. 8-connected images are scanned in
+    2x2 blocks, 4-connected images in runs, and the provisional labels
+    merged with a path compressing union-find.
 */
 int *labelconnected(unsigned char *binary, int width, int height, int connex, int *Nout)
 {
-  int *answer;
-  int *parents;
-  int label;
+  return labelcomponents(binary, width, height, connex, Nout, 0);
+}
+
+/**
+  Label connected components and gather their statistics in the same pass.
+  @param[in]  binary - the binary image
+  @param      width - image width
+  @param      height - image height
+  @param      connex - 4 or 8 connectivity
+  @param[out] Nout - number of components found
+  @param[out] stats - return for *Nout statistics records (malloced)
+  returns  Width * height array of labels for connected components.
+  \note The labels are the same as labelconnected(). stats[i] describes
+    component i, stats[0] (the background) is all zero. A perimeter
+    pixel is one with a clear pixel among its 8 neighbours, pixels off
+    the image count as clear.
+*/
+int *labelconnectedstats(unsigned char *binary, int width, int height, int connex, int *Nout, COMPONENTSTATS **stats)
+{
+  return labelcomponents(binary, width, height, connex, Nout, stats);
+}
+
+/**
+  Label connected components in binary image, multithreaded.
+  @param[in]  binary - the binary image
+  @param      width - image width
+  @param      height - image height
+  @param      connex - 4 or 8 connectivity
+  @param[out] Nout - number of components found
+  @param      Nthreads - number of threads to use
+  returns  Width * height array of labels for connected components.
+  \note The labels are identical to labelconnected(). Horizontal bands
+    are labelled on separate threads, the equivalences across the seams
+    between bands are merged, and the bands renumbered on separate threads.
+*/
+int *labelconnected_mt(unsigned char *binary, int width, int height, int connex, int *Nout, int Nthreads)
+{
+  LABELBANDS lb;
+  unsigned char *row, *up;
+  int *lab, *uplab;
+  int Nbands;
+  int Ncomponents;
+  int root;
+  int band;
   int x, y;
   int i;
-  int Nlabels = 0;
-  int northwest, north, northeast;
-  int low, high;
-  int ancestor;
-  int ancestor2;
-  int maxval;
-  int N;
 
-  answer = malloc(width*height*sizeof(int));
-  parents = malloc(width*height*sizeof(int));
-  if(!answer || !parents)
-  {
-    free(answer);
-	free(parents);
-	return 0;
-  }
+  if(Nthreads <= 1 || height < 4)
+    return labelconnected(binary, width, height, connex, Nout);
+
+  lb.binary = binary;
+  lb.width = width;
+  lb.height = height;
+  lb.connex = connex;
+  /* two bands per thread for load balancing, even so 2x2 blocks don't straddle seams */
+  lb.bandheight = (height + 2 * Nthreads - 1) / (2 * Nthreads);
+  lb.bandheight += lb.bandheight & 1;
+  Nbands = (height + lb.bandheight - 1) / lb.bandheight;
+  if(connex == 8)
+    lb.perband = ((width + 1)/2) * (lb.bandheight/2);
+  else
+    lb.perband = ((width + 1)/2) * lb.bandheight;
+
+  lb.labels = malloc((size_t) width * height * sizeof(int));
+  lb.parents = malloc(((size_t) Nbands * lb.perband + 1) * sizeof(int));
+  lb.roots = malloc(((size_t) Nbands * lb.perband + 1) * sizeof(int));
+  lb.numbers = malloc(((size_t) Nbands * lb.perband + 1) * sizeof(int));
+  lb.Nroots = malloc(Nbands * sizeof(int));
+  if(!lb.labels || !lb.parents || !lb.roots || !lb.numbers || !lb.Nroots)
+    goto error_exit;
+  lb.parents[0] = 0;
 
-  parents[0] = 0;
-  for(y=0;y<height;y++)
-    for(x=0;x<width;x++)
-	{
-	  if(binary[y*width+x] == 0)
-	    answer[y*width+x] = 0;
-	  else
-	  {
-	    if(x > 0 && binary[y*width+x-1])
-          label = answer[y*width+x-1];
-		else if(x > 0 && y > 0 && connex == 8 && binary[(y-1)*width+x-1])
-		  label = answer[(y-1)*width+x-1];
-		else if(y > 0 && binary[(y-1)*width+x])
-		  label = answer[(y-1)*width+x];
-		else if(y > 0 && x < width-1 && connex == 8 && binary[(y-1)*width+x+1])
-		  label = answer[(y-1)*width+x+1];
-		else
-		{
-		  label = ++Nlabels;
-		  parents[Nlabels] = Nlabels;
-		}
-		answer[y*width+x] = label;
-		
-		northwest = (y > 0 && x > 0) ? answer[(y-1)*width+x-1] : 0;
-		north = (y > 0) ? answer[(y-1)*width+x] : 0;
-		northeast = (y > 0 && x < width-1) ? answer[(y-1)*width+x+1] : 0;
-		if(connex == 8 && northwest != 0 && northwest != label)
-		{
-	      low = label < northwest ? label : northwest;
-		  high = label > northwest ? label : northwest;
-		  ancestor = high;
-		  while(parents[ancestor] != ancestor)
-		    ancestor = parents[ancestor];
-		  ancestor2 = low;
-          while(parents[ancestor2] != ancestor2)
-		    ancestor2 = parents[ancestor2];
-		  parents[ancestor] = parents[ancestor2];
-		  parents[low] = ancestor2;
-		  parents[high] = ancestor2;
-		}
-		if(north != 0 && north != label)
-		{
-		  low = label < north ? label : north;
-		  high = label > north ? label : north;
-		  ancestor = high;
-		  while(parents[ancestor] != ancestor)
-		    ancestor = parents[ancestor];
-
-		  ancestor2 = low;
-          while(parents[ancestor2] != ancestor2)
-		    ancestor2 = parents[ancestor2];
-		  parents[ancestor] = ancestor2;
-		  parents[low] = ancestor2;
-		  parents[high] = ancestor2;
-		}
-		if(connex == 8 && northeast != 0 && northeast != label)
-		{
-	      low = label < northeast ? label : northeast;
-		  high = label > northeast ? label : northeast;
-		  ancestor = high;
-		  while(parents[ancestor] != ancestor)
-		    ancestor = parents[ancestor];
-		  ancestor2 = low;
-          while(parents[ancestor2] != ancestor2)
-		    ancestor2 = parents[ancestor2];
-		  parents[ancestor] = ancestor2;
-		  parents[low] = ancestor2;
-		  parents[high] = ancestor2;
-		}
-	  }
-	}
+  parallel_for(Nbands, Nthreads, labelband, &lb);
 
-  maxval  = 0;
-  for(i=0;i<width*height;i++)
+  /* merge across the seams */
+  for(band=1;band<Nbands;band++)
   {
-    if(answer[i])
-	{
-	  ancestor = answer[i];
-	  while(parents[ancestor] != ancestor)
-	    ancestor = parents[ancestor];
-	  parents[answer[i]] = ancestor;
-	  answer[i] = ancestor;
-      if(maxval < answer[i])
-          maxval = answer[i];
-	}
+    y = band * lb.bandheight;
+    row = binary + (size_t) y * width;
+    up = row - width;
+    lab = lb.labels + (size_t) y * width;
+    uplab = lab - width;
+    for(x=0;x<width;x++)
+    {
+      if(!row[x])
+        continue;
+      if(up[x])
+        mergelabels(lb.parents, lab[x], uplab[x]);
+      if(connex == 8)
+      {
+        if(x > 0 && up[x-1])
+          mergelabels(lb.parents, lab[x], uplab[x-1]);
+        if(x < width-1 && up[x+1])
+          mergelabels(lb.parents, lab[x], uplab[x+1]);
+      }
+    }
   }
 
-  for(i=0;i<maxval+1;i++)
-    parents[i] = -1;
-  parents[0] = 0;
-  
-  N = 1;
-  for(i=0;i<width*height;i++)
+  /* number the components in band order, then first appearance order */
+  Ncomponents = 1;
+  for(band=0;band<Nbands;band++)
   {
-    if(parents[answer[i]] == -1)
-      parents[answer[i]] = N++;
-	answer[i] = parents[answer[i]];
+    for(i=0;i<lb.Nroots[band];i++)
+    {
+      root = lb.roots[band * lb.perband + 1 + i];
+      x = findroot(lb.parents, root);
+      if(lb.numbers[x] < 0)
+        lb.numbers[x] = Ncomponents++;
+      lb.numbers[root] = lb.numbers[x];
+    }
   }
-  
-  free(parents);
-  *Nout = N;
 
-  return answer;
+  parallel_for(Nbands, Nthreads, renumberband, &lb);
+
+  free(lb.parents);
+  free(lb.roots);
+  free(lb.numbers);
+  free(lb.Nroots);
+  *Nout = Ncomponents;
+
+  return lb.labels;
+error_exit:
+  free(lb.labels);
+  free(lb.parents);
+  free(lb.roots);
+  free(lb.numbers);
+  free(lb.Nroots);
+  return 0;
 }
 
 /**
@@ -336,55 +355,36 @@ int *labelconnected(unsigned char *binary, int width, int height, int connex, in
   @param      width - image width
   @param      height - image height
   @returns    Euler number, = number of objects - number of holes.
-  \note on error returns INT_MIN.
+  \note Objects are 8-connected, holes 4-connected. We count Gray's
+    bit-quads, the 2x2 windows over the image padded with clear pixels.
+    With Q1 windows with one pixel set, Q3 with three, and QD with two
+    set on a diagonal, the Euler number is (Q1 - Q3 - 2 QD) / 4.
+    One pass, and the image is only read.
 */
 int eulernumber(unsigned char *binary, int width, int height)
 {
-  int *labels = 0;
-  int Nlabels;
-  int *bglabels = 0;
-  int Nbglabels;
-  int i;
-  unsigned char *edgeflags = 0;
-  int answer;
-   
-  labels = labelconnected(binary, width, height, 8, &Nlabels);
-  if(!labels)
-	  goto error_exit;
-  free(labels);
-  labels = 0;
-  invertbinary(binary, width, height);
-  bglabels = labelconnected(binary, width, height, 4, &Nbglabels);
-  if(!bglabels)
-    goto error_exit;
-  invertbinary(binary, width, height);
-  edgeflags = malloc(Nbglabels);
-  if(!edgeflags)
-	  goto error_exit;
-  memset(edgeflags, 1, Nbglabels);
-  edgeflags[0] = 0;
-  /* if a hole is on the edge it is not a hole */
-  for(i=0;i<width;i++)
-  {
-    edgeflags[bglabels[i]] = 0;
-    edgeflags[bglabels[(height-1)*width+i]] = 0;
-  }
-  for(i=1;i<height-1;i++)
+  /* contribution of each 2x2 window, times four */
+  static const int quad[16] = {0, 1, 1, 0, 1, 0, -2, -1, 1, -2, 0, -1, 0, -1, -1, 0};
+  unsigned char *up, *down;
+  int left, right;
+  int answer = 0;
+  int x, y;
+
+  for(y=0;y<=height;y++)
   {
-    edgeflags[bglabels[i*width]] = 0;
-	edgeflags[bglabels[i*width+width-1]] = 0;
+    up = y > 0 ? binary + (y-1) * width : 0;
+    down = y < height ? binary + y * width : 0;
+    left = 0;
+    for(x=0;x<width;x++)
+    {
+      right = ((up && up[x]) ? 2 : 0) | ((down && down[x]) ? 1 : 0);
+      answer += quad[(left << 2) | right];
+      left = right;
+    }
+    answer += quad[left << 2];
   }
-  free(bglabels);
-  answer = Nlabels -1;
-  for(i=0;i<Nbglabels;i++)
-    if(edgeflags[i])
-	  answer--;
-  return answer;
-error_exit:
-  free(labels);
-  free(bglabels);
-  free(edgeflags);
-  return (int) ~(((unsigned)~0) >> 1);
+
+  return answer / 4;
 }
 
 /**
@@ -400,38 +400,38 @@ int getbiggestobject(unsigned char *binary, int width, int height, int connex)
 {
   int *labels;
   int Nlabels;
-  int *hist = 0;
+  COMPONENTSTATS *stats = 0;
+  COMPONENTSTATS *cs;
   int i;
+  int x, y;
   int best = 0;
   int bestlabel = -1;
 
-  labels = labelconnected(binary, width, height, connex, &Nlabels);
+  labels = labelconnectedstats(binary, width, height, connex, &Nlabels, &stats);
   if(!labels)
     goto error_exit;
-  hist = malloc(Nlabels * sizeof(int));
-  if(!hist)
-    goto error_exit;
-  for(i=0;i<Nlabels;i++)
-    hist[i] = 0;
-  for(i=0;i<width*height;i++)
-    hist[labels[i]]++;
   for(i=1;i<Nlabels;i++)
-    if(hist[i] > best)
+    if(stats[i].area > best)
 	{
-	  best = hist[i];
+	  best = stats[i].area;
 	  bestlabel = i;
 	}
-  for(i=0;i<width*height;i++)
-    if(labels[i] == bestlabel)
-	  binary[i] = 1;
-	else
-	  binary[i] = 0;
+  memset(binary, 0, width * height);
+  /* only the bounding box of the winner can have set pixels */
+  if(bestlabel > 0)
+  {
+    cs = &stats[bestlabel];
+    for(y=cs->y;y<cs->y+cs->bbheight;y++)
+      for(x=cs->x;x<cs->x+cs->bbwidth;x++)
+        if(labels[y*width+x] == bestlabel)
+          binary[y*width+x] = 1;
+  }
   free(labels);
-  free(hist);
+  free(stats);
   return 0;
 error_exit:
   free(labels);
-  free(hist);
+  free(stats);
   return -1;
 }
 
@@ -447,56 +447,13 @@ error_exit:
 */
 int branchpoints(unsigned char *binary, int width, int height, int **xout, int **yout)
 {
-  int loopindex[9] = {0, 1, 2, 5, 8, 7, 6, 3, 0};
-  unsigned char neighbours[9];
-  unsigned char loop[9];
-  int crossings;
-  int x, y;
-  int i;
-  void *temp;
-  int *branchx = 0;
-  int *branchy = 0;
-  int answer = 0;
+  unsigned char lut[512];
+  int code;
 
-  for(y=0;y<height;y++)
-	for(x=0;x<width;x++)
-	{
-      if(binary[y*width+x])
-	  {
-	    get3x3(neighbours, binary, width, height, x, y, 0);
-		for(i=0;i<9;i++)
-		  loop[i] = neighbours[loopindex[i]];
-		crossings = 0;
-		for(i=1;i<9;i++)
-		  if(loop[i] != loop[i-1])
-			  crossings++;
-		if(crossings > 4)
-		{
-		  temp = realloc(branchx, (answer +1) * sizeof(int));
-		  if(!temp)
-		    goto error_exit;
-		  branchx = temp;
-
-		  temp = realloc(branchy, (answer +1) * sizeof(int));
-		  if(!temp)
-		    goto error_exit;
-		  branchy = temp;
-
-		  branchx[answer] = x;
-          branchy[answer] = y;
-		  answer++;
-		}
-	  }
-	}
-	*xout = branchx;
-	*yout = branchy;
-	return answer;
-error_exit:
-	*xout = 0;
-	*yout = 0;
-	free(branchx);
-	free(branchy);
-	return -1;
+  for(code=0;code<512;code++)
+    lut[code] = (code & 0020) && crossings3x3(code) > 4;
+
+  return lutpoints(binary, width, height, lut, xout, yout);
 }
 
 /**
@@ -511,61 +468,18 @@ Get line end points
 */
 int lineends(unsigned char *binary, int width, int height, int **xout, int **yout)
 {
-    int loopindex[9] = {0, 1, 2, 5, 8, 7, 6, 3, 0};
-    unsigned char neighbours[9];
-    unsigned char loop[9];
-    int crossings;
-    int x, y;
-    int i;
-    void *temp;
-    int *branchx = 0;
-    int *branchy = 0;
-    int answer = 0;
-    int Nneighbours;
-    
-    for(y=0;y<height;y++)
-        for(x=0;x<width;x++)
-        {
-            if(binary[y*width+x])
-            {
-                get3x3(neighbours, binary, width, height, x, y, 0);
-                Nneighbours = mem_count(neighbours, 9, 1);
-                if(Nneighbours != 2 && Nneighbours != 3)
-                    continue;
-                for(i=0;i<9;i++)
-                    loop[i] = neighbours[loopindex[i]];
-                crossings = 0;
-                for(i=1;i<9;i++)
-                    if(loop[i] != loop[i-1])
-                        crossings++;
-                if(crossings == 2)
-                {
-                    temp = realloc(branchx, (answer +1) * sizeof(int));
-                    if(!temp)
-                        goto error_exit;
-                    branchx = temp;
-                    
-                    temp = realloc(branchy, (answer +1) * sizeof(int));
-                    if(!temp)
-                        goto error_exit;
-                    branchy = temp;
-                    
-                    branchx[answer] = x;
-                    branchy[answer] = y;
-                    answer++;
-                }
-            }
-        }
-    *xout = branchx;
-    *yout = branchy;
-    return answer;
-error_exit:
-    *xout = 0;
-    *yout = 0;
-    free(branchx);
-    free(branchy);
-    return -1;
+  unsigned char lut[512];
+  int code;
+  int Nneighbours;
+
+  for(code=0;code<512;code++)
+  {
+    Nneighbours = bitcount3x3(code);
+    lut[code] = (code & 0020) && (Nneighbours == 2 || Nneighbours == 3) &&
+                 crossings3x3(code) == 2;
+  }
 
+  return lutpoints(binary, width, height, lut, xout, yout);
 }
 
 /**
@@ -581,47 +495,13 @@ Get ends
 */
 int ends(unsigned char *binary, int width, int height, int **xout, int **yout)
 {
-  int *endx = 0;
-  int *endy = 0;
-  int answer = 0;
-  void *temp;
-  unsigned char neighbours[9];
-  int Nneighbours;
-  int x, y;
-    
-  for(y=0;y<height;y++)
-    for(x=0;x<width;x++)
-	{
-	  if(binary[y*width+x])
-	  {
-	    get3x3(neighbours, binary, width, height, x, y, 0);
-		Nneighbours = mem_count(neighbours, 9, 1);
-		if(Nneighbours == 2)
-		{
-		  temp = realloc(endx, (answer+1) * sizeof(int));
-		  if(!temp)
-		    goto error_exit;
-		  endx = temp;
-		  temp = realloc(endy, (answer+1) * sizeof(int));
-		  if(!temp)
-			goto error_exit;
-          endy = temp;
-          endx[answer] = x;
-		  endy[answer] = y;
-		  answer++;
-		}
-	  }
-	}
-  *xout = endx;
-  *yout = endy;
-  return answer;
+  unsigned char lut[512];
+  int code;
 
-error_exit:
-  free(endx);
-  free(endy);
-  *xout = 0;
-  *yout = 0;
-  return -1;
+  for(code=0;code<512;code++)
+    lut[code] = (code & 0020) && bitcount3x3(code) == 2;
+
+  return lutpoints(binary, width, height, lut, xout, yout);
 }
 
 /**
@@ -634,97 +514,281 @@ error_exit:
 */
 unsigned char *perimeter(unsigned char *binary, int width, int height)
 {
-  unsigned char *answer;
-  unsigned char neighbours[9];
-  int Nneighbours;
-  int x, y;
-  
-
-  answer = malloc(width * height);
-  if(!answer)
-    return 0;
-  for(y=0;y<height;y++)
-    for(x=0;x<width;x++)
-    {
-	  if(binary[y*width+x])
-	  {
-	    get3x3(neighbours, binary, width, height, x, y, 0);
-        Nneighbours = mem_count(neighbours, 9, 1);
-		if(Nneighbours == 9)
-	      answer[y*width+x] = 0;
-		else
-		  answer[y*width+x] = 1;
-	  }
-	  else
-		answer[y*width+x] = 0;
+  unsigned char lut[512];
+  int code;
 
-    }
+  for(code=0;code<512;code++)
+    lut[code] = (code & 0020) && code != 0777;
 
-  return answer;
+  return binary_applylut3x3(binary, width, height, lut, 0);
 }
 
 /**
-  Invert a binary image.
-  @param[in,out] binary - the binary image
+  Get the 3x3 neighbourhood codes for a row of a binary image.
+
+  @param[in] binary - the binary image
   @param width - image width
   @param height - image height
-  \note in place.
+  @param y - the row
+  @param border - value (0 or 1) for pixels off the image
+  @param[out] codes - return for the codes, must have space for width + 2
+  @note the code for each pixel is a 9-bit number, with bits
+     0400 0200 0100
+     0040 0020 0010
+     0004 0002 0001
+   so 0020 is the pixel itself. The whole row is done at once, the inner
+   loops have no branches, so operators can be written as a lookup
+   into a 512-entry table.
 */
-void invertbinary(unsigned char *binary, int width, int height)
+void neighbourcodes3x3(unsigned char *binary, int width, int height, int y, unsigned char border, unsigned short *codes)
 {
-  int i;
+  unsigned char *up, *mid, *down;
+  unsigned short bup, bdown;
+  unsigned short edge;
+  int x;
+
+  mid = binary + y * width;
+  up = y > 0 ? mid - width : 0;
+  down = y < height - 1 ? mid + width : 0;
+  bup = border ? 0100 : 0;
+  bdown = border ? 0001 : 0;
+  edge = border ? 0111 : 0;
+
+  /* first the column codes, shifted one place right */
+  codes[0] = edge;
+  for(x=0;x<width;x++)
+    codes[x+1] = (unsigned short) ((mid[x] != 0) << 3);
+  if(up)
+    for(x=0;x<width;x++)
+      codes[x+1] |= (unsigned short) ((up[x] != 0) << 6);
+  else
+    for(x=0;x<width;x++)
+      codes[x+1] |= bup;
+  if(down)
+    for(x=0;x<width;x++)
+      codes[x+1] |= (unsigned short) (down[x] != 0);
+  else
+    for(x=0;x<width;x++)
+      codes[x+1] |= bdown;
+  codes[width+1] = edge;
 
-  for(i=0;i<width*height;i++)
-    binary[i] = 1 - binary[i];
+  /* then left, centre and right columns together, in place */
+  for(x=0;x<width;x++)
+    codes[x] = (unsigned short) ((codes[x] << 2) | (codes[x+1] << 1) | codes[x+2]);
 }
 
 /**
-  Copy a binary image.
+  Apply a 3x3 lookup table to a binary image.
 
   @param[in] binary - the binary image
-  @param width - iamge width
+  @param width - image width
   @param height - image height
-  @returns Pointer to malloced copy of image, 0 on out of memory.
+  @param[in] lut - 512 entry table, indexed by neighbourhood code
+  @param border - value (0 or 1) for pixels off the image
+  @returns Malloced image of table entries, 0 on out of memory.
+  @note See neighbourcodes3x3() for the layout of the code.
 */
-unsigned char *copybinary(unsigned char *binary, int width, int height)
+unsigned char *binary_applylut3x3(unsigned char *binary, int width, int height, unsigned char *lut, unsigned char border)
 {
   unsigned char *answer;
+  unsigned short *codes;
+  int x, y;
 
   answer = malloc(width * height);
-  if(!answer)
+  codes = malloc((width + 2) * sizeof(unsigned short));
+  if(!answer || !codes)
+  {
+    free(answer);
+    free(codes);
     return 0;
-  memcpy(answer, binary, width * height);
+  }
+
+  for(y=0;y<height;y++)
+  {
+    neighbourcodes3x3(binary, width, height, y, border, codes);
+    for(x=0;x<width;x++)
+      answer[y*width+x] = lut[codes[x]];
+  }
+  free(codes);
 
   return answer;
 }
 
 /**
-  Add a border to binary image (useful for removed edge conditions)
-  @param[in]  binary - the binary image
+  Compile a set of 3x3 hit-or-miss templates to a lookup table.
+
+  @param[out] lut - return for the 512 entry table
+  @param[in] fg - Ntemplates 3x3 grids, 1 where the pixel must be set
+  @param[in] bg - Ntemplates 3x3 grids, 1 where the pixel must be clear
+  @param Ntemplates - number of templates in the set
+  @note Cells which are 0 in both grids are "don't care". The table is
+    set for a neighbourhood which matches any template in the set, and
+    is indexed by the code from neighbourcodes3x3().
+*/
+void compilehitormiss(unsigned char *lut, unsigned char *fg, unsigned char *bg, int Ntemplates)
+{
+  int code;
+  int fgmask, bgmask;
+  int i, t;
+
+  for(code=0;code<512;code++)
+    lut[code] = 0;
+  for(t=0;t<Ntemplates;t++)
+  {
+    fgmask = 0;
+    bgmask = 0;
+    for(i=0;i<9;i++)
+    {
+      if(fg[t*9+i])
+        fgmask |= 0400 >> i;
+      if(bg[t*9+i])
+        bgmask |= 0400 >> i;
+    }
+    for(code=0;code<512;code++)
+      if((code & fgmask) == fgmask && (code & bgmask) == 0)
+        lut[code] = 1;
+  }
+}
+
+/**
+  Hit-or-miss transform.
+
+  @param[in] binary - the binary image
   @param width - image width
   @param height - image height
-  @returns Pointer to malloced enlarged image, 0 on out of memory.
+  @param[in] fg - Ntemplates 3x3 grids, 1 where the pixel must be set
+  @param[in] bg - Ntemplates 3x3 grids, 1 where the pixel must be clear
+  @param Ntemplates - number of templates
+  @returns Malloced image, set where any template matches, 0 on out of memory.
+  @note pixels off the image count as clear.
 */
-unsigned char *binary_addborder(unsigned char *binary, int width, int height, int border, unsigned char fill)
+unsigned char *hitormiss(unsigned char *binary, int width, int height, unsigned char *fg, unsigned char *bg, int Ntemplates)
 {
-	unsigned char *answer;
-	int dwidth, dheight;
-	int x, y;
+  unsigned char lut[512];
 
-	dwidth = width + 2 * border;
-	dheight = height + 2 * border;
-	answer = malloc(dwidth * dheight);
-	if (!answer)
-		goto error_exit;
+  compilehitormiss(lut, fg, bg, Ntemplates);
+  return binary_applylut3x3(binary, width, height, lut, 0);
+}
 
+/**
+  Hit-or-miss transform for several template sets in one pass.
 
-	for (y = 0; y < border; y++)
-	{
-		for (x = 0; x < dwidth; x++)
-		{
-			answer[y*dwidth + x] = fill;
-		}
-	}
+  @param[in] binary - the binary image
+  @param width - image width
+  @param height - image height
+  @param[in] luts - Nsets tables, from compilehitormiss()
+  @param Nsets - number of template sets
+  @param[out] out - return for Nsets malloced images, one per set
+  @returns 0 on success, -1 on out of memory.
+  @note The neighbourhood codes are built once and looked up in every
+    table, so the image is only read once however many sets there are.
+*/
+int hitormiss_multi(unsigned char *binary, int width, int height, unsigned char **luts, int Nsets, unsigned char **out)
+{
+  unsigned short *codes = 0;
+  unsigned char *lut;
+  unsigned char *dest;
+  int x, y;
+  int i;
+
+  for(i=0;i<Nsets;i++)
+    out[i] = 0;
+  codes = malloc((width + 2) * sizeof(unsigned short));
+  if(!codes)
+    goto error_exit;
+  for(i=0;i<Nsets;i++)
+  {
+    out[i] = malloc(width * height);
+    if(!out[i])
+      goto error_exit;
+  }
+
+  for(y=0;y<height;y++)
+  {
+    neighbourcodes3x3(binary, width, height, y, 0, codes);
+    for(i=0;i<Nsets;i++)
+    {
+      lut = luts[i];
+      dest = out[i] + y * width;
+      for(x=0;x<width;x++)
+        dest[x] = lut[codes[x]];
+    }
+  }
+
+  free(codes);
+  return 0;
+error_exit:
+  free(codes);
+  for(i=0;i<Nsets;i++)
+  {
+    free(out[i]);
+    out[i] = 0;
+  }
+  return -1;
+}
+
+/**
+  Invert a binary image.
+  @param[in,out] binary - the binary image
+  @param width - image width
+  @param height - image height
+  \note in place.
+*/
+void invertbinary(unsigned char *binary, int width, int height)
+{
+  int i;
+
+  for(i=0;i<width*height;i++)
+    binary[i] = 1 - binary[i];
+}
+
+/**
+  Copy a binary image.
+
+  @param[in] binary - the binary image
+  @param width - iamge width
+  @param height - image height
+  @returns Pointer to malloced copy of image, 0 on out of memory.
+*/
+unsigned char *copybinary(unsigned char *binary, int width, int height)
+{
+  unsigned char *answer;
+
+  answer = malloc(width * height);
+  if(!answer)
+    return 0;
+  memcpy(answer, binary, width * height);
+
+  return answer;
+}
+
+/**
+  Add a border to binary image (useful for removed edge conditions)
+  @param[in]  binary - the binary image
+  @param width - image width
+  @param height - image height
+  @returns Pointer to malloced enlarged image, 0 on out of memory.
+*/
+unsigned char *binary_addborder(unsigned char *binary, int width, int height, int border, unsigned char fill)
+{
+	unsigned char *answer;
+	int dwidth, dheight;
+	int x, y;
+
+	dwidth = width + 2 * border;
+	dheight = height + 2 * border;
+	answer = malloc(dwidth * dheight);
+	if (!answer)
+		goto error_exit;
+
+
+	for (y = 0; y < border; y++)
+	{
+		for (x = 0; x < dwidth; x++)
+		{
+			answer[y*dwidth + x] = fill;
+		}
+	}
 
 	for (y = border; y < dheight - border; y++)
 	{
@@ -1182,50 +1246,919 @@ unsigned char *decompressbinary(unsigned char *comp, int *width, int *height)
 }
 
 /*
-  mem_count - count the number of bytes equal to value
-  Params: pixels - the memory
-          N - memory size
-		  value - value to test
-  Returns: number of bytes in buffer equal to value.
+  Test whether a structuring element is a disk.
+  Params: sel - the structuring element
+          swidth - structuring element width
+          sheight - structuring element height
+  Returns: the radius if sel is what sedisk() makes, else 0.
 */
-static int mem_count(unsigned char *pixels, int N, int value)
+static int isdisk(unsigned char *sel, int swidth, int sheight)
 {
-  int answer = 0;
+  int radius;
+  int x, y;
+  int c;
+
+  if(swidth != sheight || (swidth % 2) == 0)
+    return 0;
+  radius = (swidth + 1) / 2;
+  c = swidth / 2;
+  for(y=0;y<sheight;y++)
+    for(x=0;x<swidth;x++)
+      if( (sel[y*swidth+x] == 1) != ((x-c)*(x-c) + (y-c)*(y-c) < radius * radius) )
+        return 0;
+
+  return radius;
+}
+
+/*
+  Decompose a structuring element into a union of rectangles.
+  Params: sel - the structuring element
+          swidth - structuring element width
+          sheight - structuring element height
+          rects - return for the rectangles (malloced), four offsets
+                  from the origin each, left, right, top, bottom
+  Returns: number of rectangles, -1 if the element has a row which isn't
+           a single run of set cells, or on out of memory.
+  Notes: every row run is widened vertically to the tallest rectangle
+         that fits in the element. That covers the element exactly, and
+         for a disk, diamond or octagon gives one rectangle per
+         distinct row width rather than one per cell.
+*/
+static int decomposese(unsigned char *sel, int swidth, int sheight, int **rects)
+{
+  int *left = 0;
+  int *right = 0;
+  int *answer = 0;
+  int N = 0;
+  int x, y;
+  int i, j;
+  int top, bottom;
+
+  *rects = 0;
+  left = malloc(sheight * sizeof(int));
+  right = malloc(sheight * sizeof(int));
+  answer = malloc(sheight * 4 * sizeof(int));
+  if(!left || !right || !answer)
+    goto error_exit;
+
+  for(y=0;y<sheight;y++)
+  {
+    left[y] = -1;
+    right[y] = -1;
+    for(x=0;x<swidth;x++)
+      if(sel[y*swidth+x] == 1)
+      {
+        if(left[y] == -1)
+          left[y] = x;
+        else if(right[y] != x - 1)
+          goto error_exit;
+        right[y] = x;
+      }
+  }
+
+  for(y=0;y<sheight;y++)
+  {
+    if(left[y] == -1)
+      continue;
+    for(top=y;top>0;top--)
+      if(left[top-1] == -1 || left[top-1] > left[y] || right[top-1] < right[y])
+        break;
+    for(bottom=y;bottom<sheight-1;bottom++)
+      if(left[bottom+1] == -1 || left[bottom+1] > left[y] || right[bottom+1] < right[y])
+        break;
+    /* skip rectangles inside one we already have */
+    for(i=0;i<N;i++)
+      if(answer[i*4] <= left[y] - swidth/2 && answer[i*4+1] >= right[y] - swidth/2 &&
+         answer[i*4+2] <= top - sheight/2 && answer[i*4+3] >= bottom - sheight/2)
+        break;
+    if(i < N)
+      continue;
+    /* and remove any inside the new one */
+    for(i=0, j=0;i<N;i++)
+      if(!(answer[i*4] >= left[y] - swidth/2 && answer[i*4+1] <= right[y] - swidth/2 &&
+         answer[i*4+2] >= top - sheight/2 && answer[i*4+3] <= bottom - sheight/2))
+      {
+        memmove(answer + j*4, answer + i*4, 4 * sizeof(int));
+        j++;
+      }
+    N = j;
+    answer[N*4] = left[y] - swidth/2;
+    answer[N*4+1] = right[y] - swidth/2;
+    answer[N*4+2] = top - sheight/2;
+    answer[N*4+3] = bottom - sheight/2;
+    N++;
+  }
+
+  free(left);
+  free(right);
+  *rects = answer;
+  return N;
+error_exit:
+  free(left);
+  free(right);
+  free(answer);
+  return -1;
+}
+
+/*
+  Dilate or erode in place.
+  Params: binary - the binary image
+          width - image width
+          height - image height
+          sel - the structuring element
+          swidth - structuring element width
+          sheight - structuring element height
+          dilation - 1 to dilate, 0 to erode
+  Returns: 0 on success, -1 on out of memory.
+  Notes: output row y needs input rows from y - sheight/2 onwards, so we
+         keep the original of each row in a ring of sheight/2 + 2 rows
+         before writing over it. Rows below y haven't been touched yet.
+         Extra memory is O(width * sheight) rather than a whole frame,
+         and there is no copy back.
+*/
+static int morphinplace(unsigned char *binary, int width, int height, unsigned char *sel, int swidth, int sheight, int dilation)
+{
+  unsigned char *ring = 0;
+  unsigned char **rows = 0;
+  int *rects = 0;
+  int *counts = 0;
+  unsigned char *hrow = 0;
+  unsigned char *g = 0;
+  unsigned char *h = 0;
+  int Nrects;
+  int Nring;
+  int maxk = 1;
+  int i;
+  int y;
+
+  Nrects = decomposese(sel, swidth, sheight, &rects);
+  if(Nrects > 0 && Nrects * 4 >= swidth * sheight)
+    Nrects = -1;
+
+  Nring = sheight/2 + 2;
+  ring = malloc(Nring * width);
+  if(!ring)
+    goto error_exit;
+  if(Nrects > 0)
+  {
+    for(i=0;i<Nrects;i++)
+      if(maxk < rects[i*4+1] - rects[i*4] + 1)
+        maxk = rects[i*4+1] - rects[i*4] + 1;
+    counts = malloc(Nrects * width * sizeof(int));
+    hrow = malloc(width);
+    g = malloc(width + maxk);
+    h = malloc(width + maxk);
+    if(!counts || !hrow || !g || !h)
+      goto error_exit;
+  }
+  else
+  {
+    rows = malloc(sheight * sizeof(unsigned char *));
+    if(!rows)
+      goto error_exit;
+  }
+
+  for(y=0;y<height;y++)
+  {
+    memcpy(ring + (y % Nring) * width, binary + y * width, width);
+    if(Nrects > 0)
+      morphrectsrow(binary, width, height, y, ring, Nring, rects, Nrects, counts, dilation, hrow, g, h);
+    else
+      morphdirectrow(binary, width, height, y, ring, Nring, sel, swidth, sheight, rows, dilation);
+  }
+
+  free(ring);
+  free(rows);
+  free(rects);
+  free(counts);
+  free(hrow);
+  free(g);
+  free(h);
+  return 0;
+error_exit:
+  free(ring);
+  free(rows);
+  free(rects);
+  free(counts);
+  free(hrow);
+  free(g);
+  free(h);
+  return -1;
+}
+
+/*
+  original contents of row iy, when row y has been copied to the ring
+*/
+#define origrow(iy) ((iy) <= y ? ring + ((iy) % Nring) * width : binary + (iy) * width)
+
+/*
+  Dilate or erode one row by a union of rectangles.
+  Params: binary - the binary image, rows above y already done
+          width - image width
+          height - image height
+          y - the row to do
+          ring - originals of rows up to y
+          Nring - number of rows in ring
+          rects - the rectangles, from decomposese()
+          Nrects - number of rectangles
+          counts - for each rectangle, count of rows in its vertical
+                   window where the row pass is set, kept from the
+                   previous row
+          dilation - 1 to dilate, 0 to erode
+          hrow, g, h - workspace
+  Notes: a rectangle is separable. Along the row we use the van Herk /
+         Gil-Werman running max (or min), which costs the same per pixel
+         whatever the rectangle width. Down the columns we keep a running
+         count, adding the row entering the window and taking off the
+         one leaving. The union is then an OR of the dilations, or an AND
+         of the erosions.
+*/
+static void morphrectsrow(unsigned char *binary, int width, int height, int y, unsigned char *ring, int Nring,
+                          int *rects, int Nrects, int *counts, int dilation, unsigned char *hrow, unsigned char *g, unsigned char *h)
+{
+  int *count;
+  int i;
+  int x;
+  int iy;
+  int top, bottom;
+  unsigned char *out = binary + y * width;
+
+  for(i=0;i<Nrects;i++)
+  {
+    count = counts + i * width;
+    top = rects[i*4+2];
+    bottom = rects[i*4+3];
+    if(y == 0)
+    {
+      for(x=0;x<width;x++)
+        count[x] = 0;
+      for(iy=top;iy<=bottom;iy++)
+      {
+        if(iy < 0 || iy >= height)
+          continue;
+        vhgw(origrow(iy), hrow, width, rects[i*4], rects[i*4+1], dilation, g, h);
+        for(x=0;x<width;x++)
+          count[x] += hrow[x];
+      }
+    }
+    else
+    {
+      iy = y + bottom;
+      if(iy >= 0 && iy < height)
+      {
+        vhgw(origrow(iy), hrow, width, rects[i*4], rects[i*4+1], dilation, g, h);
+        for(x=0;x<width;x++)
+          count[x] += hrow[x];
+      }
+      iy = y - 1 + top;
+      if(iy >= 0 && iy < height)
+      {
+        vhgw(origrow(iy), hrow, width, rects[i*4], rects[i*4+1], dilation, g, h);
+        for(x=0;x<width;x++)
+          count[x] -= hrow[x];
+      }
+    }
+  }
+
+  for(x=0;x<width;x++)
+    out[x] = dilation ? 0 : 1;
+  for(i=0;i<Nrects;i++)
+  {
+    count = counts + i * width;
+    if(dilation)
+    {
+      for(x=0;x<width;x++)
+        out[x] |= count[x] > 0;
+    }
+    else
+    {
+      bottom = rects[i*4+3] - rects[i*4+2] + 1;
+      for(x=0;x<width;x++)
+        out[x] &= count[x] == bottom;
+    }
+  }
+}
+
+/*
+  Dilate or erode one row, testing every cell of the structuring element.
+  Params: binary - the binary image, rows above y already done
+          width - image width
+          height - image height
+          y - the row to do
+          ring - originals of rows up to y
+          Nring - number of rows in ring
+          sel - the structuring element
+          swidth - structuring element width
+          sheight - structuring element height
+          rows - workspace for sheight row pointers
+          dilation - 1 to dilate, 0 to erode
+*/
+static void morphdirectrow(unsigned char *binary, int width, int height, int y, unsigned char *ring, int Nring,
+                           unsigned char *sel, int swidth, int sheight, unsigned char **rows, int dilation)
+{
+  int x, sx, sy, ix, iy;
+  int bit;
+  unsigned char pix;
+
+  for(sy=0;sy<sheight;sy++)
+  {
+    iy = y + sy - sheight/2;
+    rows[sy] = (iy < 0 || iy >= height) ? 0 : origrow(iy);
+  }
+
+  for(x=0;x<width;x++)
+  {
+    pix = dilation ? 0 : 1;
+    for(sy=0;sy<sheight;sy++)
+      for(sx=0;sx<swidth;sx++)
+      {
+        if(sel[sy*swidth+sx] != 1)
+          continue;
+        ix = x + sx - swidth/2;
+        if(!rows[sy] || ix < 0 || ix >= width)
+          bit = 0;
+        else
+          bit = rows[sy][ix];
+        if(dilation && bit == 1)
+        {
+          pix = 1;
+          goto done;
+        }
+        if(!dilation && bit == 0)
+        {
+          pix = 0;
+          goto done;
+        }
+      }
+  done:
+    binary[y*width+x] = pix;
+  }
+}
+
+#undef origrow
+
+/*
+  van Herk / Gil-Werman running max or min of a row.
+  Params: in - the input row
+          out - the output row
+          N - number of pixels in the row
+          a, b - the window, out[i] takes in[i+a] to in[i+b]
+          dilation - 1 for max, 0 for min
+          g, h - workspace, N + b - a bytes
+  Notes: pixels off the row count as 0. The row is split into
+         blocks of the window length, g holds the running value from
+         the start of each block and h from the end, so each output is
+         just h at the window start combined with g at the window end.
+         Input pixels are set if 1 for dilation, and if non-zero for
+         erosion, to match the cell by cell test.
+*/
+static void vhgw(unsigned char *in, unsigned char *out, int N, int a, int b, int dilation, unsigned char *g, unsigned char *h)
+{
+  int k = b - a + 1;
+  int L = N + k - 1;
+  int i, t;
+
+  for(t=0;t<L;t++)
+  {
+    if(t + a < 0 || t + a >= N)
+      g[t] = 0;
+    else if(dilation)
+      g[t] = in[t+a] == 1;
+    else
+      g[t] = in[t+a] != 0;
+  }
+  for(t=0;t<L;t++)
+    h[t] = g[t];
+
+  for(t=0;t<L;t++)
+    if(t % k)
+      g[t] = dilation ? (g[t] | g[t-1]) : (g[t] & g[t-1]);
+  for(t=L-2;t>=0;t--)
+    if((t+1) % k)
+      h[t] = dilation ? (h[t] | h[t+1]) : (h[t] & h[t+1]);
+
+  for(i=0;i<N;i++)
+    out[i] = dilation ? (h[i] | g[i+k-1]) : (h[i] & g[i+k-1]);
+}
+
+/*
+  Provisional 8-connected labelling in 2x2 blocks.
+  Params: binary - the binary image
+          width - image width
+          height - image height
+          labels - return for provisional labels, width * height
+          parents - union-find forest, indexed by label
+          base - labels are allocated from base + 1
+  Returns: number of provisional labels allocated.
+  Notes: the set pixels of a 2x2 block are always 8-connected to each
+    other, so the block takes one label. It connects to the block
+    above left if a and o are set, the block above if one of b, c and
+    one of o, p is set, the block above right if d and p are set, and the
+    block to the left if one of l, m and one of o, s is set.
+      a b c d
+      l o p
+      m s t
+    Each neighbour label is read from a set pixel of that block, so
+    we need no buffer of block labels.
+*/
+static int labelblocks8(unsigned char *binary, int width, int height, int *labels, int *parents, int base)
+{
+  unsigned char *row0, *row1, *up;
+  int *lab0, *lab1, *uplab;
+  int o, p, s, t;
+  int label;
+  int N = 0;
+  int x, y;
+
+  for(y=0;y<height;y+=2)
+  {
+    row0 = binary + y * width;
+    row1 = (y + 1 < height) ? row0 + width : 0;
+    lab0 = labels + y * width;
+    lab1 = lab0 + width;
+    up = row0 - width;
+    uplab = lab0 - width;
+    for(x=0;x<width;x+=2)
+    {
+      o = row0[x] != 0;
+      p = x + 1 < width && row0[x+1];
+      s = row1 && row1[x];
+      t = row1 && x + 1 < width && row1[x+1];
+      label = 0;
+      if(o | p | s | t)
+      {
+        if(y > 0)
+        {
+          if(o && x > 0 && up[x-1])
+            label = uplab[x-1];
+          if((o | p) && (up[x] || (x + 1 < width && up[x+1])))
+            label = mergelabels(parents, label, up[x] ? uplab[x] : uplab[x+1]);
+          if(p && x + 2 < width && up[x+2])
+            label = mergelabels(parents, label, uplab[x+2]);
+        }
+        if(x > 0 && (o | s))
+        {
+          if(row0[x-1])
+            label = mergelabels(parents, label, lab0[x-1]);
+          else if(row1 && row1[x-1])
+            label = mergelabels(parents, label, lab1[x-1]);
+        }
+        if(label == 0)
+        {
+          label = base + ++N;
+          parents[label] = label;
+        }
+      }
+      lab0[x] = o ? label : 0;
+      if(x + 1 < width)
+        lab0[x+1] = p ? label : 0;
+      if(row1)
+      {
+        lab1[x] = s ? label : 0;
+        if(x + 1 < width)
+          lab1[x+1] = t ? label : 0;
+      }
+    }
+  }
+
+  return N;
+}
+
+/*
+  Provisional 4-connected labelling in runs.
+  Params: binary - the binary image
+          width - image width
+          height - image height
+          labels - return for provisional labels, width * height
+          parents - union-find forest, indexed by label
+          base - labels are allocated from base + 1
+  Returns: number of provisional labels allocated.
+  Notes: each horizontal run of set pixels takes one label, merged
+    with every run it overlaps in the row above.
+*/
+static int labelruns4(unsigned char *binary, int width, int height, int *labels, int *parents, int base)
+{
+  unsigned char *row, *up;
+  int *lab, *uplab;
+  int label;
+  int N = 0;
+  int x, y;
+  int start;
+
+  for(y=0;y<height;y++)
+  {
+    row = binary + y * width;
+    up = row - width;
+    lab = labels + y * width;
+    uplab = lab - width;
+    x = 0;
+    while(x < width)
+    {
+      if(!row[x])
+      {
+        lab[x++] = 0;
+        continue;
+      }
+      label = 0;
+      start = x;
+      while(x < width && row[x])
+      {
+        if(y > 0 && up[x] && (x == start || !up[x-1]))
+          label = mergelabels(parents, label, uplab[x]);
+        x++;
+      }
+      if(label == 0)
+      {
+        label = base + ++N;
+        parents[label] = label;
+      }
+      while(start < x)
+        lab[start++] = label;
+    }
+  }
+
+  return N;
+}
+
+/*
+  Label connected components.
+  Params: binary - the binary image
+          width - image width
+          height - image height
+          connex - 4 or 8 connectivity
+          Nout - return for number of components plus one
+          stats - return for component statistics, 0 if not wanted
+  Returns: the labels, 0 on out of memory.
+*/
+static int *labelcomponents(unsigned char *binary, int width, int height, int connex, int *Nout, COMPONENTSTATS **stats)
+{
+  int *answer = 0;
+  int *parents = 0;
+  int Nlabels;
+  int N;
+
+  answer = malloc(width*height*sizeof(int));
+  if(!answer)
+    goto error_exit;
+  if(connex == 8)
+    parents = malloc((((width+1)/2) * ((height+1)/2) + 1) * sizeof(int));
+  else
+    parents = malloc((((width+1)/2) * height + 1) * sizeof(int));
+  if(!parents)
+    goto error_exit;
+
+  parents[0] = 0;
+  if(connex == 8)
+    Nlabels = labelblocks8(binary, width, height, answer, parents, 0);
+  else
+    Nlabels = labelruns4(binary, width, height, answer, parents, 0);
+  if(stats)
+    N = relabelstats(binary, width, height, answer, parents, Nlabels, stats);
+  else
+    N = relabelraster(answer, width*height, parents, Nlabels);
+  if(N < 0)
+    goto error_exit;
+  free(parents);
+
+  *Nout = N;
+  return answer;
+error_exit:
+  free(answer);
+  free(parents);
+  return 0;
+}
+
+/*
+  Resolve provisional labels to final component numbers.
+  Params: labels - the provisional labels, overwritten
+          N - number of pixels
+          parents - union-find forest, indexed by label
+          Nlabels - number of provisional labels
+  Returns: number of components plus one (for the background).
+  Notes: components are numbered in raster order of their first pixel.
+    Since a parent always has a lower label than its child, one pass
+    in label order points every label straight at its root. We then
+    store the component number as a negative value at the root.
+*/
+static int relabelraster(int *labels, int N, int *parents, int Nlabels)
+{
+  int Ncomponents = 1;
+  int root;
   int i;
 
+  for(i=1;i<=Nlabels;i++)
+    parents[i] = parents[parents[i]];
+
   for(i=0;i<N;i++)
-    if(pixels[i] == value)
-	  answer++;
-	
+  {
+    if(labels[i] == 0)
+      continue;
+    root = parents[labels[i]];
+    if(root < 0)
+    {
+      labels[i] = -root;
+      continue;
+    }
+    if(parents[root] == root)
+      parents[root] = -Ncomponents++;
+    labels[i] = -parents[root];
+  }
+
+  return Ncomponents;
+}
+
+/*
+  Resolve provisional labels and gather component statistics.
+  Params: binary - the binary image
+          width - image width
+          height - image height
+          labels - the provisional labels, overwritten
+          parents - union-find forest, indexed by label
+          Nlabels - number of provisional labels
+          stats - return for the statistics (malloced)
+  Returns: number of components plus one, -1 on out of memory.
+  Notes: as relabelraster(), but we count the roots first so we can
+    allocate the statistics, then accumulate them as we relabel.
+*/
+static int relabelstats(unsigned char *binary, int width, int height, int *labels, int *parents, int Nlabels,
+                        COMPONENTSTATS **stats)
+{
+  COMPONENTSTATS *answer;
+  COMPONENTSTATS *cs;
+  unsigned short *codes;
+  int *row;
+  int Ncomponents = 1;
+  int root;
+  int x, y;
+  int i;
+
+  for(i=1;i<=Nlabels;i++)
+  {
+    parents[i] = parents[parents[i]];
+    if(parents[i] == i)
+      Ncomponents++;
+  }
+  answer = calloc(Ncomponents, sizeof(COMPONENTSTATS));
+  codes = malloc((width + 2) * sizeof(unsigned short));
+  if(!answer || !codes)
+  {
+    free(answer);
+    free(codes);
+    return -1;
+  }
+
+  Ncomponents = 1;
+  for(y=0;y<height;y++)
+  {
+    row = labels + y * width;
+    neighbourcodes3x3(binary, width, height, y, 0, codes);
+    for(x=0;x<width;x++)
+    {
+      if(row[x] == 0)
+        continue;
+      root = parents[row[x]];
+      if(root < 0)
+        row[x] = -root;
+      else
+      {
+        if(parents[root] == root)
+        {
+          parents[root] = -Ncomponents;
+          cs = &answer[Ncomponents++];
+          cs->firstx = x;
+          cs->firsty = y;
+          cs->x = x;
+          cs->y = y;
+          cs->bbwidth = x;
+          cs->bbheight = y;
+        }
+        row[x] = -parents[root];
+      }
+
+      cs = &answer[row[x]];
+      cs->area++;
+      if(cs->x > x)
+        cs->x = x;
+      if(cs->bbwidth < x)
+        cs->bbwidth = x;
+      cs->bbheight = y;
+      if(codes[x] != 0777)
+        cs->perimeter++;
+      cs->m10 += x;
+      cs->m01 += y;
+      cs->m20 += (double) x * x;
+      cs->m11 += (double) x * y;
+      cs->m02 += (double) y * y;
+    }
+  }
+  free(codes);
+
+  /* bbwidth and bbheight held the right and bottom edges */
+  for(i=1;i<Ncomponents;i++)
+  {
+    cs = &answer[i];
+    cs->bbwidth = cs->bbwidth - cs->x + 1;
+    cs->bbheight = cs->bbheight - cs->y + 1;
+    cs->cx = cs->m10 / cs->area;
+    cs->cy = cs->m01 / cs->area;
+  }
+
+  *stats = answer;
+  return Ncomponents;
+}
+
+/*
+  labelconnected_mt() job, label one band.
+  Notes: the band is labelled as a separate image. Its labels are then
+    pointed straight at their roots and the roots listed in the order
+    they first appear, with a number of -1 to mark them as seen.
+*/
+static void labelband(void *ptr, int band)
+{
+  LABELBANDS *lb = ptr;
+  unsigned char *binary;
+  int *labels;
+  int *parents = lb->parents;
+  int base = band * lb->perband;
+  int y0, y1;
+  int N;
+  int Nroots = 0;
+  int root;
+  int i;
+
+  y0 = band * lb->bandheight;
+  y1 = y0 + lb->bandheight < lb->height ? y0 + lb->bandheight : lb->height;
+  binary = lb->binary + (size_t) y0 * lb->width;
+  labels = lb->labels + (size_t) y0 * lb->width;
+
+  if(lb->connex == 8)
+    N = labelblocks8(binary, lb->width, y1 - y0, labels, parents, base);
+  else
+    N = labelruns4(binary, lb->width, y1 - y0, labels, parents, base);
+
+  for(i=base+1;i<=base+N;i++)
+  {
+    parents[i] = parents[parents[i]];
+    lb->numbers[i] = 0;
+  }
+  for(i=0;i<(y1 - y0) * lb->width;i++)
+  {
+    if(labels[i] == 0)
+      continue;
+    root = parents[labels[i]];
+    if(lb->numbers[root] == 0)
+    {
+      lb->numbers[root] = -1;
+      lb->roots[base + 1 + Nroots++] = root;
+    }
+  }
+  lb->Nroots[band] = Nroots;
+}
+
+/*
+  labelconnected_mt() job, replace a band's labels with the component numbers.
+  Notes: every label points at its local root, or at another local root
+    in the same component if the seam merge shortened its path.
+*/
+static void renumberband(void *ptr, int band)
+{
+  LABELBANDS *lb = ptr;
+  int *labels;
+  int y0, y1;
+  int i;
+
+  y0 = band * lb->bandheight;
+  y1 = y0 + lb->bandheight < lb->height ? y0 + lb->bandheight : lb->height;
+  labels = lb->labels + (size_t) y0 * lb->width;
+
+  for(i=0;i<(y1 - y0) * lb->width;i++)
+    if(labels[i])
+      labels[i] = lb->numbers[lb->parents[labels[i]]];
+}
+
+/*
+  Find the root of a label, halving the path as we go.
+*/
+static int findroot(int *parents, int label)
+{
+  while(parents[label] != label)
+  {
+    parents[label] = parents[parents[label]];
+    label = parents[label];
+  }
+  return label;
+}
+
+/*
+  Merge two labels, label a may be 0 for none.
+  Returns: the root of the merged set, which is the lower of the two roots.
+*/
+static int mergelabels(int *parents, int a, int b)
+{
+  if(a == 0)
+    return findroot(parents, b);
+  a = findroot(parents, a);
+  b = findroot(parents, b);
+  if(a < b)
+  {
+    parents[b] = a;
+    return a;
+  }
+  parents[a] = b;
+  return b;
+}
+
+/*
+  Find the pixels where a 3x3 lookup table is set.
+  Params: binary - the binary image
+          width - image width
+          height - image height
+          lut - 512 entry table, indexed by neighbourhood code
+          xout - return for x co-ordinates (malloced)
+          yout - return for y co-ordinates (malloced)
+  Returns: number of points, -1 on out of memory.
+*/
+static int lutpoints(unsigned char *binary, int width, int height, unsigned char *lut, int **xout, int **yout)
+{
+  unsigned short *codes;
+  int *px = 0;
+  int *py = 0;
+  void *temp;
+  int capacity = 0;
+  int answer = 0;
+  int x, y;
+
+  codes = malloc((width + 2) * sizeof(unsigned short));
+  if(!codes)
+    goto error_exit;
+
+  for(y=0;y<height;y++)
+  {
+    neighbourcodes3x3(binary, width, height, y, 0, codes);
+    for(x=0;x<width;x++)
+    {
+      if(!lut[codes[x]])
+        continue;
+      if(answer >= capacity)
+      {
+        capacity = capacity + capacity/2 + 16;
+        temp = realloc(px, capacity * sizeof(int));
+        if(!temp)
+          goto error_exit;
+        px = temp;
+        temp = realloc(py, capacity * sizeof(int));
+        if(!temp)
+          goto error_exit;
+        py = temp;
+      }
+      px[answer] = x;
+      py[answer] = y;
+      answer++;
+    }
+  }
+  free(codes);
+
+  *xout = px;
+  *yout = py;
   return answer;
+error_exit:
+  free(codes);
+  free(px);
+  free(py);
+  *xout = 0;
+  *yout = 0;
+  return -1;
 }
 
 /*
-  get 3x3 neighbourhood, padding for boundaries
-  Params: out - return pointer for neighbourhood
-          binary - the binary image
-		  width - image width
-		  height - image height
-		  x, y - centre pixel x, y co-ordinates
-          border - value to pad borders with.
-  Notes: pattern returned is
-             0  1  2
-			 3  4  5
-			 6  7  8
-         where 4 is the pixel at x, y.
+  number of set pixels in a 3x3 neighbourhood code
+*/
+static int bitcount3x3(int code)
+{
+  int answer = 0;
+
+  while(code)
+  {
+    answer += code & 1;
+    code >>= 1;
+  }
+  return answer;
+}
 
+/*
+  number of changes between set and clear going round the
+  eight neighbours of a 3x3 neighbourhood code
 */
-static void get3x3(unsigned char *out, unsigned char *binary, int width, int height, int x, int y, unsigned char border)
+static int crossings3x3(int code)
 {
-	if(y > 0 && x > 0)        out[0] = binary[(y-1)*width+x-1]; else out[0] = border;
-	if(y > 0)                 out[1] = binary[(y-1)*width+x];   else out[1] = border;
-	if(y > 0 && x < width-1)  out[2] = binary[(y-1)*width+x+1]; else out[2] = border;
-	if(x > 0)                 out[3] = binary[y*width+x-1];     else out[3] = border;
-	                          out[4] = binary[y*width+x];
-	if(x < width-1)           out[5] = binary[y*width+x+1];     else out[5] = border;
-	if(y < height-1 && x > 0) out[6] = binary[(y+1)*width+x-1]; else out[6] = border;
-	if(y < height-1)          out[7] = binary[(y+1)*width+x];   else out[7] = border;
-	if(y < height-1 && x < width-1) out[8] = binary[(y+1)*width+x+1]; else out[8] = border; 
+  static const int loop[9] = {0400, 0200, 0100, 0010, 0001, 0002, 0004, 0040, 0400};
+  int answer = 0;
+  int i;
+
+  for(i=1;i<9;i++)
+    if(!(code & loop[i]) != !(code & loop[i-1]))
+      answer++;
+  return answer;
 }
 
 static void get2x2(unsigned char *out, unsigned char *binary, int width, int height, int x,
@@ -1312,10 +2245,16 @@ int getcontours(unsigned char *binary, int width, int height, double ***x, doubl
                            {
                                capacity = capacity + capacity/2 + 10;
                                temp = realloc(contourN, capacity * sizeof(int));
+                               if(!temp)
+                                   goto out_of_memory;
                                contourN = temp;
-                                temp = realloc(contourx, capacity * sizeof(double *));
+                               temp = realloc(contourx, capacity * sizeof(double *));
+                               if(!temp)
+                                   goto out_of_memory;
                                contourx = temp;
                                temp = realloc(contoury, capacity * sizeof(double *));
+                               if(!temp)
+                                   goto out_of_memory;
                                contoury = temp;
                            }
                            contourN[answer] = cN;
@@ -1323,6 +2262,8 @@ int getcontours(unsigned char *binary, int width, int height, double ***x, doubl
                            contoury[answer] = cy;
                            answer++;
                        }
+                       else
+                           goto out_of_memory;
                     }
                     /*
                     if( (binary[yi*width+xi] & CNT_TOPRIGHT) == 0 &&
@@ -1362,6 +2303,31 @@ int getcontours(unsigned char *binary, int width, int height, double ***x, doubl
     *Nret = contourN;
     
     return answer;
+    
+out_of_memory:
+    if(err == 0)
+    {
+        free(cx);
+        free(cy);
+    }
+    for(i=0;i<answer;i++)
+    {
+        free(contourx[i]);
+        free(contoury[i]);
+    }
+    free(contourx);
+    free(contoury);
+    free(contourN);
+    for(yi=0;yi<height;yi++)
+    {
+        for(xi=0;xi<width;xi++)
+            binary[yi*width+xi] &= 0x01;
+    }
+    *x = 0;
+    *y = 0;
+    *Nret = 0;
+    
+    return -1;
 }
     
 static int walkcontour(unsigned char *binary, int width, int height, int x, int y, int dir, double **cx,
@@ -1,16 +1,44 @@
 #ifndef binaryutils_h
 #define binaryutils_h
+
+/*
+  Statistics for one connected component, from labelconnectedstats().
+*/
+typedef struct
+{
+  int area;                /**< number of pixels */
+  int x;                   /**< bounding box left */
+  int y;                   /**< bounding box top */
+  int bbwidth;             /**< bounding box width */
+  int bbheight;            /**< bounding box height */
+  int firstx;              /**< x co-ordinate of first pixel in raster order */
+  int firsty;              /**< y co-ordinate of first pixel in raster order */
+  int perimeter;           /**< number of pixels with a clear 8-neighbour */
+  double cx;               /**< centroid x */
+  double cy;               /**< centroid y */
+  double m10, m01;         /**< raw moments, sums of x and y */
+  double m20, m11, m02;    /**< raw moments, sums of x*x, x*y and y*y */
+} COMPONENTSTATS;
+
 int morphclose(unsigned char *binary, int width, int height, unsigned char *sel, int swidth, int sheight);
 int morphopen(unsigned char *binary, int width, int height, unsigned char *sel, int swidth, int sheight);
+void setmorphdiskradius(int radius);
 int dilate(unsigned char *binary, int width, int height, unsigned char *sel, int swidth, int sheight);
 int erode(unsigned char *binary, int width, int height, unsigned char *sel, int swidth, int sheight);
 int *labelconnected(unsigned char *binary, int width, int height, int connex, int *Nout);
+int *labelconnected_mt(unsigned char *binary, int width, int height, int connex, int *Nout, int Nthreads);
+int *labelconnectedstats(unsigned char *binary, int width, int height, int connex, int *Nout, COMPONENTSTATS **stats);
 int eulernumber(unsigned char *binary, int width, int height);
 int getbiggestobject(unsigned char *binary, int width, int height, int connex);
 int branchpoints(unsigned char *binary, int width, int height, int **xout, int **yout);
 int lineends(unsigned char *binary, int width, int height, int **xout, int **yout);
 int ends(unsigned char *binary, int width, int height, int **xout, int **yout);
 unsigned char *perimeter(unsigned char *binary, int width, int height);
+void neighbourcodes3x3(unsigned char *binary, int width, int height, int y, unsigned char border, unsigned short *codes);
+unsigned char *binary_applylut3x3(unsigned char *binary, int width, int height, unsigned char *lut, unsigned char border);
+void compilehitormiss(unsigned char *lut, unsigned char *fg, unsigned char *bg, int Ntemplates);
+unsigned char *hitormiss(unsigned char *binary, int width, int height, unsigned char *fg, unsigned char *bg, int Ntemplates);
+int hitormiss_multi(unsigned char *binary, int width, int height, unsigned char **luts, int Nsets, unsigned char **out);
 void invertbinary(unsigned char *binary, int width, int height);
 unsigned char *copybinary(unsigned char *binary, int width, int height);
 unsigned char *subbinary(unsigned char *binary, int width, int height, int x, int y, int swidth, int sheight);
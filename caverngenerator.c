@@ -53,93 +53,61 @@ out_of_memory:
 	return 0;
 }
 
+/*
+  join the caverns by walking from each one towards the centre
+  until we reach another cavern.
+*/
 static int connect(unsigned char *binary, int width, int height)
 {
 	int N;
 	int *ids;
-	unsigned char *flags;
-	unsigned int *closex;
-	unsigned int *closey;
+	COMPONENTSTATS *stats = 0;
 	int i;
 	int x, y;
-	int id;
 	int cx, cy;
-	int d1, d2;
 	int dx, dy;
 	double p;
 
 	cx = width / 2;
 	cy = height / 2;
 
-	ids = labelconnected(binary, width, height, 4, &N);
-	flags = malloc(N);
-	closex = malloc((N+1) * sizeof(int));
-	closey = malloc((N+1) * sizeof(int));
-
-	
-	for (i = 0; i < N; i++)
-	{
-		flags[i] = 0;
-		closex[i] = width + 100;
-		closey[i] = height + 100;
-	}
+	ids = labelconnectedstats(binary, width, height, 4, &N, &stats);
+	if (!ids)
+		return -1;
 
-	for (y = 0; y < height; y++)
+	for (i = 1; i < N; i++)
 	{
-		for (x = 0; x < width; x++)
+		if (ids[cy*width + cx] == i)
+			continue;
+		x = stats[i].firstx;
+		y = stats[i].firsty;
+		while (x != cx || y != cy)
 		{
-			id = ids[y*width + x];
-			if (id > 0)
+			dx = cx - x;
+			dy = cy - y;
+			p = ((double)abs(dx)) / (abs(dx) + abs(dy));
+			if (uniform() < p)
 			{
-
-				d1 = (closex[id] - cx)*(closex[id] - cx) + (closey[id] - cy)*(closey[id] - cy);
-				d2 = (x - cx) *(x - cx) + (y - cy)*(y - cy);
-				if (d2 < d1)
-				{
-					closex[id] = x;
-					closey[id] = y;
-				}
+				dx = sign(dx);
+				dy = 0;
 			}
-		}
-	}
-	
-
-	for (i = 1; i < N; i++)
-	{
-		if (closex[i] != cx || closey[i] != cy)
-		{
-			x = closex[i];
-			y = closey[i];
-			while (x != cx || y != cy)
+			else
 			{
-				dx = cx - x;
-				dy = cy - y;
-				p = ((double)abs(dx)) / (abs(dx) + abs(dy));
-				if (uniform() < p)
-				{
-					dx = sign(dx);
-					dy = 0;
-				}
-				else
-				{
-					dx = 0;
-					dy = sign(dy);
-				}
-				x += dx;
-				y += dy;
-				binary[y*width + x] = 1;
-				if (ids[y*width + x] != id)
-					break;
+				dx = 0;
+				dy = sign(dy);
 			}
+			x += dx;
+			y += dy;
+			binary[y*width + x] = 1;
+			if (ids[y*width + x] != 0 && ids[y*width + x] != i)
+				break;
 		}
 	}
 
-
 	free(ids);
-	free(flags);
-	free(closex);
-	free(closey);
+	free(stats);
 
+	return 0;
 }
 
 static void breakbackground8connections(unsigned char *binary, int width, int height)
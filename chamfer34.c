@@ -1,8 +1,10 @@
 #include <stdlib.h>
+#include <string.h>
 #include <limits.h>
 
+#include "chamfer34.h"
+
 #define min2(a,b) ((a) < (b) ? (a) : (b))
-#define min4(a,b,c,d) min2(min2(a,b), min2(c,d))
 
 /**
    @brief distance transform using chamfer 3-4 rule
@@ -18,63 +20,66 @@
    4  3  4
    3  x  .  the ratio 4:3 stands for 1: root2
 
+   Pixels off the image count as background.
 */
 int *chamfer34(unsigned char *binary, int width, int height)
 {
   int *padded = 0;
   int *answer =  0;
-  int x, y;
-  int i;
+  int y;
   int pwidth = width + 2;
-  int distup, distdown;
 
-  padded = malloc( (width +2) * (height+2) * sizeof(int));
+  padded = chamfer34padded(binary, width, height, 0);
   if(!padded)
     goto out_of_memory;
   answer = malloc(width*height*sizeof(int));
   if(!answer)
     goto out_of_memory;
 
-  for(i=0;i<(width+2)*(height+2);i++)
-    padded[i] = 0;
-
   for(y=0;y<height;y++)
-    for(x=0;x<width;x++)
-      if(binary[y*width+x] != 0)
-        padded[(y+1)*pwidth+x+1] = INT_MAX - 10;
+    memcpy(answer + y*width, padded + (y+1)*pwidth + 1, width * sizeof(int));
 
-  for(y=1;y<height+1;y++)
-  {
-    for(x=1;x<width+1;x++)
-    {
-      distup = min4(padded[(y-1)*pwidth+x-1]+4,
-                    padded[(y-1)*pwidth+x]+3,
-                    padded[(y-1)*pwidth+x+1]+4,
-                    padded[y*pwidth+x-1] +3);
-      if(distup < padded[y*pwidth+x])
-        padded[y * pwidth+x] = distup; 
-    }
-  }
+  free(padded);
+  return answer;
+ out_of_memory:
+  free(padded);
+  free(answer);
+  return 0;
+}
 
- 
-  for(y=height+1; y >= 1; y--)
-  {
-    for(x=width+1; x >= 1; x--)
-    {
-      distdown = min4(padded[(y+1)*pwidth+x+1]+4,
-                      padded[(y+1)*pwidth+x]+3,
-                      padded[(y+1)*pwidth+x-1]+4,
-                      padded[y*pwidth+x+1]+3);
-      if(distdown < padded[y*pwidth+x])
-	padded[y*pwidth+x] = distdown;
-
-    }
-  }
+/**
+   @brief chamfer 3-4 distance transform, 16 bit output
+   @param[in] binary - the binary image
+   @param width - image width
+   @param height  image height
+   @return the transform as unsigned shorts
+
+   Same as chamfer34(), but distances over 65535 saturate.
+   The returned buffer is half the size, for when the result goes
+   straight to a texture. The working buffer is still padded ints.
+*/
+unsigned short *chamfer34_u16(unsigned char *binary, int width, int height)
+{
+  int *padded = 0;
+  unsigned short *answer = 0;
+  int *row;
+  int x, y;
+  int pwidth = width + 2;
+
+  padded = chamfer34padded(binary, width, height, 0);
+  if(!padded)
+    goto out_of_memory;
+  answer = malloc(width*height*sizeof(unsigned short));
+  if(!answer)
+    goto out_of_memory;
 
   for(y=0;y<height;y++)
+  {
+    row = padded + (y+1)*pwidth + 1;
     for(x=0;x<width;x++)
-      answer[y*width+x] = padded[(y+1)*pwidth+x+1];
-    
+      answer[y*width+x] = (unsigned short) min2(row[x], 65535);
+  }
+
   free(padded);
   return answer;
  out_of_memory:
@@ -83,6 +88,69 @@ int *chamfer34(unsigned char *binary, int width, int height)
   return 0;
 }
 
+/*
+   the two passes, into an image with a one pixel border.
+
+   Each pass works a row at a time. First the three pixels on the
+   previous row are folded in for the whole row, with no dependencies
+   between pixels, so the compiler can vectorise it. Then the pixel
+   alongside is folded in with a running minimum along the row.
+   That gives exactly the same result as visiting the pixels one by one.
+
+   The border is zero if border is 0, else INT_MAX - 10, the value a
+   set pixel starts with. A set pixel with no clear pixel to measure
+   to keeps that value. distancetransform() uses this as its chamfer
+   3-4 kernel.
+*/
+int *chamfer34padded(unsigned char *binary, int width, int height, int border)
+{
+  int *padded;
+  int *row, *prev;
+  int x, y;
+  int pwidth = width + 2;
+  int off = border ? INT_MAX - 10 : 0;
+
+  padded = malloc( (size_t) (width +2) * (height+2) * sizeof(int));
+  if(!padded)
+    return 0;
+
+  for(x=0;x<pwidth;x++)
+  {
+    padded[x] = off;
+    padded[(size_t) (height+1)*pwidth + x] = off;
+  }
+  for(y=0;y<height;y++)
+  {
+    row = padded + (size_t) (y+1)*pwidth;
+    row[0] = off;
+    row[width+1] = off;
+    for(x=0;x<width;x++)
+      row[x+1] = binary[y*width+x] != 0 ? INT_MAX - 10 : 0;
+  }
+
+  for(y=1;y<height+1;y++)
+  {
+    row = padded + (size_t) y*pwidth;
+    prev = row - pwidth;
+    for(x=1;x<width+1;x++)
+      row[x] = min2(row[x], min2(min2(prev[x-1], prev[x+1]) + 4, prev[x] + 3));
+    for(x=1;x<width+1;x++)
+      row[x] = min2(row[x], row[x-1] + 3);
+  }
+
+  for(y=height; y >= 1; y--)
+  {
+    row = padded + (size_t) y*pwidth;
+    prev = row + pwidth;
+    for(x=1;x<width+1;x++)
+      row[x] = min2(row[x], min2(min2(prev[x-1], prev[x+1]) + 4, prev[x] + 3));
+    for(x=width; x >= 1; x--)
+      row[x] = min2(row[x], row[x+1] + 3);
+  }
+
+  return padded;
+}
+
 #include <stdio.h>
 int testchamfer34main(void)
 {
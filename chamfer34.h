@@ -0,0 +1,10 @@
+#ifndef chamfer34_h
+#define chamfer34_h
+
+int *chamfer34(unsigned char *binary, int width, int height);
+unsigned short *chamfer34_u16(unsigned char *binary, int width, int height);
+
+/* the raw passes, with a one pixel border, used by distancetransform() */
+int *chamfer34padded(unsigned char *binary, int width, int height, int border);
+
+#endif
@@ -0,0 +1,840 @@
+/**@file
+   Contour extraction with hierarchy.
+
+   The border following algorithm of Suzuki and Abe, "Topological
+   structural analysis of digitized binary images by border following",
+   1985. One raster scan finds the start of every border, outer borders
+   of the set pixels and the borders of the holes in them, and each is
+   followed round as soon as it is found. Followed pixels are marked
+   with the border's number, which tells the scan which borders have
+   been done, and which border encloses the next one it finds.
+
+   Set pixels are 8-connected, holes 4-connected. Contour points are
+   the centres of the border pixels, outer borders going anticlockwise
+   on the screen (y down) and hole borders clockwise.
+
+   The marks go in a private label buffer, so the caller's image is
+   not touched.
+
+   By Malcolm McLean.
+*/
+#include <stdlib.h>
+#include <string.h>
+
+#include "contours.h"
+
+typedef struct
+{
+  CONTOURSET *cs;         /* the set under construction */
+  int contourcapacity;    /* space for contours */
+  int pointcapacity;      /* space for points */
+} CSBUILD;
+
+/* a corner of a border from run-length data, in a linked list */
+typedef struct
+{
+  int x;          /* corner x */
+  int y;          /* corner y */
+  int next;       /* next corner along the border, -1 at the end */
+} RLCORNER;
+
+/* a piece of border, with both ends still open */
+typedef struct
+{
+  int first;      /* first corner */
+  int last;       /* last corner */
+  int origin;     /* corner the piece was started with */
+  int root;       /* piece this one was joined to, own index if none */
+  int left;       /* piece with the nearest run edge to the left at the start, -1 if none */
+  int isouter;    /* started at the top left of a component rather than a hole */
+  int contour;    /* index in the closed contours, -1 if still open */
+} RLPIECE;
+
+typedef struct
+{
+  unsigned char *comp;    /* the compressed image */
+  int width;              /* image width */
+  int pos;                /* next byte of the stream */
+  int flag;               /* set if the current run is of set pixels */
+  int remaining;          /* pixels left in the current run */
+  RLCORNER *corners;      /* all corners */
+  int Ncorners;           /* number of corners */
+  int cornercapacity;     /* space for corners */
+  RLPIECE *pieces;        /* all pieces of border */
+  int Npieces;            /* number of pieces */
+  int piececapacity;      /* space for pieces */
+  CSBUILD closed;         /* contours in the order they close */
+} RLCONTOURS;
+
+/* a handle on one end of a piece of border */
+#define RL_TAIL(piece) ((piece) * 2)
+#define RL_HEAD(piece) ((piece) * 2 + 1)
+
+static void followborder(int *lab, int pw, int p, int dir, int nbd, CSBUILD *csb, int *err);
+static int rl_readrow(RLCONTOURS *rl, int *ends);
+static int rl_boundary(RLCONTOURS *rl, int y, int *above, int *abovehandles, int Nabove, int *below, int *belowhandles, int Nbelow);
+static int rl_newpiece(RLCONTOURS *rl, int x, int y, int left, int isouter);
+static int rl_addcorner(RLCONTOURS *rl, int handle, int x, int y);
+static int rl_join(RLCONTOURS *rl, int handle1, int handle2, int x, int y);
+static int rl_close(RLCONTOURS *rl, int piece);
+static int rl_find(RLCONTOURS *rl, int piece);
+static CONTOURSET *rl_sortcontours(RLCONTOURS *rl);
+static CONTOURSET *newcontourset(CSBUILD *csb);
+static int addcontour(CSBUILD *csb, int parent, int ishole);
+static int addpoint(CSBUILD *csb, int x, int y);
+
+/**
+  Get all the contours of a binary image.
+
+  @param[in] binary - the image
+  @param width - image width
+  @param height - image height
+  @returns The contours, 0 on out of memory.
+  @note Contours are numbered in the order their first pixel comes in a
+    raster scan, so a contour's parent always comes before it. Borders
+    of a component one pixel wide go over some pixels twice. An
+    isolated pixel is a contour of one point.
+*/
+CONTOURSET *getcontourset(unsigned char *binary, int width, int height)
+{
+  CSBUILD csb;
+  CONTOURSET *cs;
+  int *lab = 0;
+  int pw = width + 2;
+  int nbd = 1;
+  int lnbd;
+  int parent;
+  int ishole;
+  int x, y, p;
+  int v;
+  int err = 0;
+
+  cs = newcontourset(&csb);
+  if(!cs)
+    return 0;
+  lab = calloc((size_t) pw * (height + 2), sizeof(int));
+  if(!lab)
+    goto out_of_memory;
+  for(y=0;y<height;y++)
+    for(x=0;x<width;x++)
+      lab[(y+1)*pw+x+1] = binary[y*width+x] ? 1 : 0;
+
+  for(y=1;y<=height;y++)
+  {
+    /* the frame counts as the border of a hole, number 1 */
+    lnbd = 1;
+    for(x=1;x<=width;x++)
+    {
+      p = y*pw+x;
+      v = lab[p];
+      if(v == 0)
+        continue;
+      if(v == 1 && lab[p-1] == 0)
+        ishole = 0;
+      else if(v >= 1 && lab[p+1] == 0)
+      {
+        ishole = 1;
+        if(v > 1)
+          lnbd = v;
+      }
+      else
+        ishole = -1;
+
+      if(ishole >= 0)
+      {
+        nbd++;
+        /* a border of the other kind from the last one encloses us */
+        if(lnbd == 1)
+          parent = -1;
+        else if(cs->ishole[lnbd-2] == ishole)
+          parent = cs->parent[lnbd-2];
+        else
+          parent = lnbd-2;
+        if(addcontour(&csb, parent, ishole))
+          goto out_of_memory;
+        followborder(lab, pw, p, ishole ? 0 : 4, nbd, &csb, &err);
+        if(err)
+          goto out_of_memory;
+      }
+      if(lab[p] != 1)
+        lnbd = lab[p] < 0 ? -lab[p] : lab[p];
+    }
+  }
+  cs->start[cs->Ncontours] = cs->Npoints;
+
+  free(lab);
+  return cs;
+out_of_memory:
+  free(lab);
+  killcontourset(cs);
+  return 0;
+}
+
+/**
+  Contour set destructor.
+
+  @param cs - the contour set
+*/
+void killcontourset(CONTOURSET *cs)
+{
+  if(cs)
+  {
+    free(cs->start);
+    free(cs->parent);
+    free(cs->ishole);
+    free(cs->x);
+    free(cs->y);
+    free(cs);
+  }
+}
+
+/**
+  Get the points of a contour set as 16 bit integers.
+
+  @param[in] cs - the contour set
+  @returns The pool of points as x, y pairs (malloced), 0 on out of
+    memory or if a co-ordinate won't fit.
+  @note Half the size of the int pool, for when the contours are stored
+    or sent on. The start offsets index it in pairs.
+*/
+short *contourset_points16(CONTOURSET *cs)
+{
+  short *answer;
+  int i;
+
+  for(i=0;i<cs->Npoints;i++)
+    if(cs->x[i] < -32768 || cs->x[i] > 32767 || cs->y[i] < -32768 || cs->y[i] > 32767)
+      return 0;
+  answer = malloc(cs->Npoints * 2 * sizeof(short) + 1);
+  if(!answer)
+    return 0;
+  for(i=0;i<cs->Npoints;i++)
+  {
+    answer[i*2] = (short) cs->x[i];
+    answer[i*2+1] = (short) cs->y[i];
+  }
+
+  return answer;
+}
+
+/**
+  Get all the contours of a run-length compressed binary image.
+
+  @param[in] comp - the image, as compressbinary() gives
+  @returns The contours, 0 on out of memory.
+  @note The image is never decompressed. Rows are read from the stream
+    one at a time as lists of runs, and the borders built up from the
+    run edges of each pair of rows, so the work goes with the number of
+    runs rather than pixels.
+  @note Points are pixel corners, as in getcontours(), and only the
+    corners where the border turns, so a rectangle has four points.
+    Each contour starts at its top left corner. The contours, their
+    order, nesting and direction are otherwise as getcontourset().
+*/
+CONTOURSET *getcontourset_rle(unsigned char *comp)
+{
+  RLCONTOURS rl;
+  CONTOURSET *answer = 0;
+  int width, height;
+  int *above = 0, *below = 0;
+  int *abovehandles = 0, *belowhandles = 0;
+  int *temp;
+  int Nabove = 0, Nbelow;
+  int y;
+
+  width = ((int) comp[0] << 8) | comp[1];
+  height = ((int) comp[2] << 8) | comp[3];
+  memset(&rl, 0, sizeof(RLCONTOURS));
+  rl.comp = comp;
+  rl.width = width;
+  rl.flag = comp[4] != 0;
+  rl.remaining = comp[5];
+  rl.pos = 6;
+  if(!newcontourset(&rl.closed))
+    return 0;
+  above = malloc((width + 2) * sizeof(int));
+  below = malloc((width + 2) * sizeof(int));
+  abovehandles = malloc((width + 2) * sizeof(int));
+  belowhandles = malloc((width + 2) * sizeof(int));
+  if(!above || !below || !abovehandles || !belowhandles)
+    goto out_of_memory;
+
+  for(y=0;y<=height;y++)
+  {
+    Nbelow = y < height ? rl_readrow(&rl, below) : 0;
+    if(rl_boundary(&rl, y, above, abovehandles, Nabove, below, belowhandles, Nbelow))
+      goto out_of_memory;
+    temp = above;
+    above = below;
+    below = temp;
+    temp = abovehandles;
+    abovehandles = belowhandles;
+    belowhandles = temp;
+    Nabove = Nbelow;
+  }
+  answer = rl_sortcontours(&rl);
+
+out_of_memory:
+  free(above);
+  free(below);
+  free(abovehandles);
+  free(belowhandles);
+  free(rl.corners);
+  free(rl.pieces);
+  killcontourset(rl.closed.cs);
+  return answer;
+}
+
+/*
+  Follow a border round, marking it and adding its points.
+  Params: lab - the label buffer, with a one pixel border of zeros
+          pw - label buffer width
+          p - start pixel
+          dir - direction of the clear pixel which shows the start is
+                on a border, 4 (left) for an outer border, 0 (right)
+                for a hole
+          nbd - number of the border
+          csb - the contour set under construction
+          err - set to -1 on out of memory
+  Notes: directions go E, SE, S, SW, W, NW, N, NE. The pixel's mark is
+         minus the border number if its right neighbour is clear and
+         was looked at, which stops the scan starting a hole there
+         again, else the border number if it is still unmarked.
+*/
+static void followborder(int *lab, int pw, int p, int dir, int nbd, CSBUILD *csb, int *err)
+{
+  int off[8];
+  int p1, p3, p4 = 0;
+  int d, k;
+  int rightclear;
+
+  off[0] = 1;
+  off[1] = pw+1;
+  off[2] = pw;
+  off[3] = pw-1;
+  off[4] = -1;
+  off[5] = -pw-1;
+  off[6] = -pw;
+  off[7] = -pw+1;
+
+  /* the first set neighbour clockwise from the clear one */
+  for(k=0;k<8;k++)
+  {
+    d = (dir + k) & 7;
+    if(lab[p + off[d]])
+      break;
+  }
+  if(k == 8)
+  {
+    lab[p] = -nbd;
+    if(addpoint(csb, p % pw - 1, p / pw - 1))
+      *err = -1;
+    return;
+  }
+  p1 = p + off[d];
+  p3 = p;
+  for(;;)
+  {
+    /* the next set neighbour anticlockwise from the pixel we came from */
+    rightclear = 0;
+    for(k=1;k<=8;k++)
+    {
+      dir = (d - k) & 7;
+      p4 = p3 + off[dir];
+      if(lab[p4])
+        break;
+      if(dir == 0)
+        rightclear = 1;
+    }
+    if(rightclear)
+      lab[p3] = -nbd;
+    else if(lab[p3] == 1)
+      lab[p3] = nbd;
+    if(addpoint(csb, p3 % pw - 1, p3 / pw - 1))
+    {
+      *err = -1;
+      return;
+    }
+    if(p4 == p && p3 == p1)
+      break;
+    d = (dir + 4) & 7;
+    p3 = p4;
+  }
+}
+
+/*
+  Read the next row of a compressed image.
+  Params: rl - the contour extraction
+          ends - return for the set runs, start and end (one past) of each
+  Returns: number of entries in ends, twice the number of runs.
+  Notes: a run of 255 followed by one of 0 continues a long run, which
+         the merge of touching runs takes care of.
+*/
+static int rl_readrow(RLCONTOURS *rl, int *ends)
+{
+  int width = rl->width;
+  int N = 0;
+  int x = 0;
+  int n;
+
+  while(x < width)
+  {
+    while(rl->remaining == 0)
+    {
+      rl->flag = !rl->flag;
+      rl->remaining = rl->comp[rl->pos++];
+    }
+    n = rl->remaining < width - x ? rl->remaining : width - x;
+    if(rl->flag)
+    {
+      if(N > 0 && ends[N-1] == x)
+        ends[N-1] = x + n;
+      else
+      {
+        ends[N++] = x;
+        ends[N++] = x + n;
+      }
+    }
+    x += n;
+    rl->remaining -= n;
+  }
+
+  return N;
+}
+
+/*
+  Build the borders along the line between two rows.
+  Params: rl - the contour extraction
+          y - the line, the top of row y
+          above - run ends of the row above
+          abovehandles - the border ends on the run edges above
+          Nabove - number of run ends above
+          below - run ends of the row below
+          belowhandles - return for the border ends on the run edges below
+          Nbelow - number of run ends below
+  Returns: 0 on success, -1 on out of memory.
+  Notes: we go along the line from run edge to run edge, taking the
+         ends of borders down from the row above and carrying one along
+         the line where the rows differ. A corner has one vertical and
+         one horizontal edge. Where the set pixels meet diagonally
+         there are two corners, joined so the set pixels are
+         8-connected. Borders go with the set pixels on the left, that
+         is down the left edges of runs and up the right.
+*/
+static int rl_boundary(RLCONTOURS *rl, int y, int *above, int *abovehandles, int Nabove, int *below, int *belowhandles, int Nbelow)
+{
+  int ia = 0, ib = 0;
+  int x;
+  int isabove, isbelow;
+  int tl, tr, bl, br;
+  int hab;
+  int hl = -1;
+  int left;
+  int piece;
+
+  while(ia < Nabove || ib < Nbelow)
+  {
+    if(ib >= Nbelow || (ia < Nabove && above[ia] <= below[ib]))
+      x = above[ia];
+    else
+      x = below[ib];
+    isabove = ia < Nabove && above[ia] == x;
+    isbelow = ib < Nbelow && below[ib] == x;
+    /* the four pixels round the point, starts of runs at even indices */
+    tr = isabove ? !(ia & 1) : (ia & 1);
+    tl = isabove ? (ia & 1) : tr;
+    br = isbelow ? !(ib & 1) : (ib & 1);
+    bl = isbelow ? (ib & 1) : br;
+    hab = isabove ? abovehandles[ia] : -1;
+    left = ib > 0 ? belowhandles[ib-1] / 2 : -1;
+
+    if(tl == br && tr == bl && tl != tr)
+    {
+      if(tl)
+      {
+        if(rl_addcorner(rl, hl, x, y) || rl_addcorner(rl, hab, x, y))
+          return -1;
+        belowhandles[ib] = hl;
+        hl = hab;
+      }
+      else
+      {
+        if(rl_join(rl, hab, hl, x, y))
+          return -1;
+        piece = rl_newpiece(rl, x, y, left, 0);
+        if(piece < 0)
+          return -1;
+        belowhandles[ib] = RL_TAIL(piece);
+        hl = RL_HEAD(piece);
+      }
+    }
+    else if(isabove && isbelow)
+      belowhandles[ib] = hab;
+    else if(isabove)
+    {
+      if(tl != bl)
+      {
+        if(rl_join(rl, hab, hl, x, y))
+          return -1;
+        hl = -1;
+      }
+      else
+      {
+        if(rl_addcorner(rl, hab, x, y))
+          return -1;
+        hl = hab;
+      }
+    }
+    else
+    {
+      if(tl != bl)
+      {
+        if(rl_addcorner(rl, hl, x, y))
+          return -1;
+        belowhandles[ib] = hl;
+        hl = -1;
+      }
+      else
+      {
+        piece = rl_newpiece(rl, x, y, left, br);
+        if(piece < 0)
+          return -1;
+        belowhandles[ib] = br ? RL_HEAD(piece) : RL_TAIL(piece);
+        hl = br ? RL_TAIL(piece) : RL_HEAD(piece);
+      }
+    }
+    if(isabove)
+      ia++;
+    if(isbelow)
+      ib++;
+  }
+
+  return 0;
+}
+
+/*
+  Start a new piece of border at a corner.
+  Params: rl - the contour extraction
+          x, y - the corner
+          left - piece to the left on the row below, -1 if none
+          isouter - set for the top left of a component, clear for a hole
+  Returns: the piece, -1 on out of memory.
+*/
+static int rl_newpiece(RLCONTOURS *rl, int x, int y, int left, int isouter)
+{
+  RLPIECE *temp;
+  RLPIECE *piece;
+  int capacity;
+  int corner;
+
+  if(rl->Npieces == rl->piececapacity)
+  {
+    capacity = rl->piececapacity + rl->piececapacity/2 + 64;
+    temp = realloc(rl->pieces, capacity * sizeof(RLPIECE));
+    if(!temp)
+      return -1;
+    rl->pieces = temp;
+    rl->piececapacity = capacity;
+  }
+  piece = &rl->pieces[rl->Npieces];
+  piece->first = -1;
+  piece->last = -1;
+  piece->root = rl->Npieces;
+  piece->left = left;
+  piece->isouter = isouter;
+  piece->contour = -1;
+  if(rl_addcorner(rl, RL_HEAD(rl->Npieces), x, y))
+    return -1;
+  corner = rl->Ncorners - 1;
+  piece = &rl->pieces[rl->Npieces];
+  piece->origin = corner;
+
+  return rl->Npieces++;
+}
+
+/*
+  Add a corner to one end of a piece of border.
+  Params: rl - the contour extraction
+          handle - the end
+          x, y - the corner
+  Returns: 0 on success, -1 on out of memory.
+*/
+static int rl_addcorner(RLCONTOURS *rl, int handle, int x, int y)
+{
+  RLCORNER *temp;
+  RLPIECE *piece;
+  int capacity;
+  int corner;
+
+  if(rl->Ncorners == rl->cornercapacity)
+  {
+    capacity = rl->cornercapacity + rl->cornercapacity/2 + 256;
+    temp = realloc(rl->corners, capacity * sizeof(RLCORNER));
+    if(!temp)
+      return -1;
+    rl->corners = temp;
+    rl->cornercapacity = capacity;
+  }
+  corner = rl->Ncorners++;
+  rl->corners[corner].x = x;
+  rl->corners[corner].y = y;
+  rl->corners[corner].next = -1;
+  piece = &rl->pieces[rl_find(rl, handle / 2)];
+  if(piece->first < 0)
+  {
+    piece->first = corner;
+    piece->last = corner;
+  }
+  else if(handle & 1)
+  {
+    rl->corners[piece->last].next = corner;
+    piece->last = corner;
+  }
+  else
+  {
+    rl->corners[corner].next = piece->first;
+    piece->first = corner;
+  }
+
+  return 0;
+}
+
+/*
+  Join the head of one piece of border to the tail of another at a corner.
+  Params: rl - the contour extraction
+          handle1, handle2 - the ends, one head and one tail, either order
+          x, y - the corner
+  Returns: 0 on success, -1 on out of memory.
+  Notes: if the ends are of the same piece the border is closed.
+*/
+static int rl_join(RLCONTOURS *rl, int handle1, int handle2, int x, int y)
+{
+  int head = (handle1 & 1) ? handle1 : handle2;
+  int tail = (handle1 & 1) ? handle2 : handle1;
+  int rh, rt;
+  int root;
+  int first, last;
+
+  if(rl_addcorner(rl, head, x, y))
+    return -1;
+  rh = rl_find(rl, head / 2);
+  rt = rl_find(rl, tail / 2);
+  if(rh == rt)
+    return rl_close(rl, rh);
+
+  /* the older piece stands for the joined one */
+  first = rl->pieces[rh].first;
+  last = rl->pieces[rt].last;
+  rl->corners[rl->pieces[rh].last].next = rl->pieces[rt].first;
+  root = rh < rt ? rh : rt;
+  rl->pieces[rh].root = root;
+  rl->pieces[rt].root = root;
+  rl->pieces[root].first = first;
+  rl->pieces[root].last = last;
+
+  return 0;
+}
+
+/*
+  Store a closed border.
+  Params: rl - the contour extraction
+          piece - the piece, a root
+  Returns: 0 on success, -1 on out of memory.
+  Notes: the oldest piece of a border was started at its top left
+         corner, which the contour starts from.
+*/
+static int rl_close(RLCONTOURS *rl, int piece)
+{
+  RLPIECE *p = &rl->pieces[piece];
+  int corner;
+
+  p->contour = rl->closed.cs->Ncontours;
+  if(addcontour(&rl->closed, -1, !p->isouter))
+    return -1;
+  for(corner = p->origin; corner != -1; corner = rl->corners[corner].next)
+    if(addpoint(&rl->closed, rl->corners[corner].x, rl->corners[corner].y))
+      return -1;
+  for(corner = p->first; corner != p->origin; corner = rl->corners[corner].next)
+    if(addpoint(&rl->closed, rl->corners[corner].x, rl->corners[corner].y))
+      return -1;
+
+  return 0;
+}
+
+/*
+  Find the piece of border which stands for all those joined to it.
+*/
+static int rl_find(RLCONTOURS *rl, int piece)
+{
+  int root = piece;
+  int next;
+
+  while(rl->pieces[root].root != root)
+    root = rl->pieces[root].root;
+  while(piece != root)
+  {
+    next = rl->pieces[piece].root;
+    rl->pieces[piece].root = root;
+    piece = next;
+  }
+
+  return root;
+}
+
+/*
+  Put the closed contours in the order of their top left corners, and
+  fill in the parents.
+  Params: rl - the contour extraction
+  Returns: the contour set, 0 on out of memory.
+  Notes: a contour's parent is found from the piece to the left of its
+         first corner, as in getcontourset(). That piece is older, so
+         its contour comes first and has its parent already.
+*/
+static CONTOURSET *rl_sortcontours(RLCONTOURS *rl)
+{
+  CSBUILD csb;
+  CONTOURSET *closed = rl->closed.cs;
+  CONTOURSET *cs;
+  int *newindex;
+  int parent;
+  int i, j, k, q;
+
+  closed->start[closed->Ncontours] = closed->Npoints;
+  cs = newcontourset(&csb);
+  if(!cs)
+    return 0;
+  newindex = malloc(closed->Ncontours * sizeof(int) + 1);
+  if(!newindex)
+    goto out_of_memory;
+  for(i=0;i<rl->Npieces;i++)
+  {
+    if(rl->pieces[i].root != i || rl->pieces[i].contour < 0)
+      continue;
+    k = rl->pieces[i].contour;
+    if(rl->pieces[i].left < 0)
+      parent = -1;
+    else
+    {
+      q = rl_find(rl, rl->pieces[i].left);
+      parent = newindex[rl->pieces[q].contour];
+      if(rl->pieces[q].isouter == rl->pieces[i].isouter)
+        parent = cs->parent[parent];
+    }
+    newindex[k] = cs->Ncontours;
+    if(addcontour(&csb, parent, closed->ishole[k]))
+      goto out_of_memory;
+    for(j=closed->start[k];j<closed->start[k+1];j++)
+      if(addpoint(&csb, closed->x[j], closed->y[j]))
+        goto out_of_memory;
+  }
+  cs->start[cs->Ncontours] = cs->Npoints;
+
+  free(newindex);
+  return cs;
+out_of_memory:
+  free(newindex);
+  killcontourset(cs);
+  return 0;
+}
+
+/*
+  Create an empty contour set.
+  Params: csb - the build record to set up
+  Returns: the contour set, 0 on out of memory.
+*/
+static CONTOURSET *newcontourset(CSBUILD *csb)
+{
+  CONTOURSET *cs;
+
+  cs = malloc(sizeof(CONTOURSET));
+  if(!cs)
+    return 0;
+  cs->Ncontours = 0;
+  cs->Npoints = 0;
+  cs->parent = 0;
+  cs->ishole = 0;
+  cs->x = 0;
+  cs->y = 0;
+  cs->start = malloc(sizeof(int));
+  if(!cs->start)
+  {
+    free(cs);
+    return 0;
+  }
+  cs->start[0] = 0;
+  csb->cs = cs;
+  csb->contourcapacity = 0;
+  csb->pointcapacity = 0;
+
+  return cs;
+}
+
+/*
+  Start a new contour, at the end of the point pool.
+  Params: csb - the contour set under construction
+          parent - the enclosing contour, -1 for none
+          ishole - set if the border of a hole
+  Returns: 0 on success, -1 on out of memory.
+*/
+static int addcontour(CSBUILD *csb, int parent, int ishole)
+{
+  CONTOURSET *cs = csb->cs;
+  void *temp;
+  int capacity;
+
+  if(cs->Ncontours == csb->contourcapacity)
+  {
+    capacity = csb->contourcapacity + csb->contourcapacity/2 + 16;
+    temp = realloc(cs->start, (capacity + 1) * sizeof(int));
+    if(!temp)
+      return -1;
+    cs->start = temp;
+    temp = realloc(cs->parent, capacity * sizeof(int));
+    if(!temp)
+      return -1;
+    cs->parent = temp;
+    temp = realloc(cs->ishole, capacity);
+    if(!temp)
+      return -1;
+    cs->ishole = temp;
+    csb->contourcapacity = capacity;
+  }
+  cs->start[cs->Ncontours] = cs->Npoints;
+  cs->parent[cs->Ncontours] = parent;
+  cs->ishole[cs->Ncontours] = ishole ? 1 : 0;
+  cs->Ncontours++;
+
+  return 0;
+}
+
+/*
+  Add a point to the current contour.
+  Params: csb - the contour set under construction
+          x, y - the point
+  Returns: 0 on success, -1 on out of memory.
+*/
+static int addpoint(CSBUILD *csb, int x, int y)
+{
+  CONTOURSET *cs = csb->cs;
+  int *temp;
+  int capacity;
+
+  if(cs->Npoints == csb->pointcapacity)
+  {
+    capacity = csb->pointcapacity + csb->pointcapacity/2 + 256;
+    temp = realloc(cs->x, capacity * sizeof(int));
+    if(!temp)
+      return -1;
+    cs->x = temp;
+    temp = realloc(cs->y, capacity * sizeof(int));
+    if(!temp)
+      return -1;
+    cs->y = temp;
+    csb->pointcapacity = capacity;
+  }
+  cs->x[cs->Npoints] = x;
+  cs->y[cs->Npoints] = y;
+  cs->Npoints++;
+
+  return 0;
+}
@@ -0,0 +1,25 @@
+#ifndef contours_h
+#define contours_h
+
+/*
+  A set of contours with their nesting.
+  The points of all the contours are in one pool, contour i runs from
+  start[i] to start[i+1] - 1.
+*/
+typedef struct
+{
+  int Ncontours;          /**< number of contours */
+  int *start;             /**< Ncontours + 1 offsets into the point pool */
+  int *parent;            /**< enclosing contour, -1 for an outermost border */
+  unsigned char *ishole;  /**< 1 for the border of a hole, 0 for an outer border */
+  int Npoints;            /**< number of points in the pool */
+  int *x;                 /**< pool x co-ordinates */
+  int *y;                 /**< pool y co-ordinates */
+} CONTOURSET;
+
+CONTOURSET *getcontourset(unsigned char *binary, int width, int height);
+CONTOURSET *getcontourset_rle(unsigned char *comp);
+void killcontourset(CONTOURSET *cs);
+short *contourset_points16(CONTOURSET *cs);
+
+#endif
@@ -5,69 +5,184 @@
  * Saito's exact EDT  - a Euclidean distance transfrom that returns
  * exact results.
  *  
+ * Also Meijster's exact EDT, which is linear in the number of pixels
+ * and runs on several threads.
  *
  */
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <float.h>
 #include <math.h>
 
+#include "distancetransform.h"
+#include "chamfer34.h"
+#include "parallel.h"
+
 float *euclideandistancetransform(unsigned char *binary, int width, int height);
 int *edt_saito(unsigned char *binary, int width, int height);
+int *edt_meijster(unsigned char *binary, int width, int height, int border, int Nthreads);
+float *edt_meijsterf(unsigned char *binary, int width, int height, int border, int Nthreads);
+void *distancetransform(unsigned char *binary, int width, int height, DTOPTIONS *opt);
+float *signeddistancefield(unsigned char *binary, int width, int height, int subpixel, int Nthreads);
+void *signeddistancefieldq(unsigned char *binary, int width, int height, int subpixel, int bits, double scale, int Nthreads);
+int dilate_disk(unsigned char *binary, int width, int height, int radius);
+int erode_disk(unsigned char *binary, int width, int height, int radius);
 
-/*
-  gift-wraps edt_saito.
-  The function doesn't handle the case where set pixels touch the border
-  Also, it returns the square of the distnace as an integer
+/* columns per job in the first phase of edt_meijster() */
+#define MEIJSTER_COLUMNS 256
+
+typedef struct
+{
+  unsigned char *binary;  /* the image */
+  int width;              /* image width */
+  int height;             /* image height */
+  int metric;             /* DT_EUCLIDEAN, DT_CITYBLOCK or DT_CHESSBOARD */
+  int border;             /* pixels off the image are set (1) or clear (0) */
+  int bandheight;         /* rows per job in the second phase */
+  int *dt;                /* the result, vertical distances after phase one */
+  int *errors;            /* error return per row band */
+} MEIJSTER;
+
+typedef struct
+{
+  unsigned char *binary;  /* the image */
+  int width;              /* image width */
+  int height;             /* image height */
+  int subpixel;           /* put the edge half way between pixels */
+  int bits;               /* 0 for float output, else 8 or 16 */
+  double scale;           /* quantisation levels per pixel */
+  int bandheight;         /* rows per job in the second phase */
+  int *gin;               /* vertical distance to clear pixels */
+  int *gout;              /* vertical distance to set pixels */
+  void *out;              /* the result */
+  int *errors;            /* error return per row band */
+} SDF;
+
+struct distancemap
+{
+  unsigned char *binary;  /* our copy of the image */
+  int width;              /* image width */
+  int height;             /* image height */
+  int Nthreads;           /* threads for full recomputes */
+  int threshold;          /* edits in a batch before we recompute everything */
+  int *g;                 /* vertical distance to the nearest clear pixel */
+  int *dt;                /* squared Euclidean distance transform */
+  unsigned char *dirty;   /* rows whose vertical distances have changed */
+  int *f;                 /* row workspaces for envelope() */
+  int *s;
+  int *t;
+  int *d;
+};
+
+typedef struct
+{
+  DISTANCEMAP *dm;        /* the map */
+  int bandheight;         /* rows per job */
+  int *errors;            /* error return per row band */
+} DMBANDS;
+
+static int dm_recompute(DISTANCEMAP *dm);
+static void dm_bandrows(void *ptr, int band);
+static void dm_column(DISTANCEMAP *dm, int x, int y);
+static int dm_row(DISTANCEMAP *dm, int y, int *g, int *dt, int *f, int *s, int *t, int *d, int *xmin, int *xmax);
+static void *sdf(unsigned char *binary, int width, int height, int subpixel, int bits, double scale, int Nthreads);
+static void sdfcolumns(void *ptr, int block);
+static void sdfrows(void *ptr, int band);
+static int *separabledt(unsigned char *binary, int width, int height, int metric, int border, int Nthreads);
+static void meijstercolumns(void *ptr, int block);
+static void meijsterrows(void *ptr, int band);
+static void envelope(int metric, int *g, int *d, int width, int *f, int *s, int *t);
+static int *chamfer34dt(unsigned char *binary, int width, int height, int border);
+
+/**
+  Euclidean distance transform.
 
   @param[in] binary - the binary image
   @param width - image width
   @param height - image height
   @returns The distance transform as a float.
+  @note Set pixels get the distance to the nearest clear pixel, and
+    pixels off the image count as clear.
 */
 float *euclideandistancetransform(unsigned char *binary, int width, int height)
 {
-  unsigned char *bordered = 0;
+  return edt_meijsterf(binary, width, height, 0, 1);
+}
+
+/**
+  Dilate with a disk.
+
+  @param[in,out] binary - the binary image
+  @param width - image width
+  @param height - image height
+  @param radius - disk radius
+  @returns 0 on success, -1 on out of memory.
+  @note Gives the same result as dilate() with the structuring
+    element from sedisk(radius), but by thresholding the squared
+    distance transform of the background, so the time doesn't
+    depend on the radius.
+*/
+int dilate_disk(unsigned char *binary, int width, int height, int radius)
+{
+  unsigned char *inverted = 0;
   int *dt = 0;
-  float *answer = 0;
-  int x, y;
+  int i;
 
-  bordered = malloc( (width + 2) * (height + 2) );
-  if(!bordered)
-	goto error_exit;
-   
-  for(y=0;y<height;y++)
-    for(x=0;x<width;x++)
-	  bordered[ (y + 1)* (width + 2) + x + 1] = binary[y*width+x];
-	  
-  for(x=0;x<width+2;x++)
-  {
-    bordered[x] = 0;
-    bordered[(height+1)*(width+2)+x] = 0;
-  }
-  for(y=0;y<height+2;y++)
+  for(i=0;i<width*height;i++)
+    if(binary[i] == 1)
+      break;
+  if(i == width * height)
   {
-    bordered[y*(width+2)] = 0;
-	bordered[y*(width+2)+width+1] = 0;
+    for(i=0;i<width*height;i++)
+      binary[i] = 0;
+    return 0;
   }
-  
-  dt = edt_saito(bordered, width + 2, height + 2);
-  if(!dt)
-	goto error_exit;
-
-  answer = malloc(width * height * sizeof(float));
-  if(!answer)
-	  goto error_exit;
 
-  for(y=0;y<height;y++)
-    for(x=0;x<width;x++)
-	  answer[y*width+x] = (float) sqrt(dt[(y+1)*(width+2) + x + 1]);
+  inverted = malloc((size_t) width * height + 1);
+  if(!inverted)
+    goto error_exit;
+  for(i=0;i<width*height;i++)
+    inverted[i] = binary[i] == 1 ? 0 : 1;
+  dt = edt_meijster(inverted, width, height, 1, 1);
+  if(!dt)
+    goto error_exit;
+  for(i=0;i<width*height;i++)
+    binary[i] = dt[i] < radius * radius ? 1 : 0;
 
+  free(inverted);
   free(dt);
-  free(bordered);
-  return answer;
+  return 0;
 error_exit:
-  free(bordered);
+  free(inverted);
   free(dt);
-  free(answer);
+  return -1;
+}
+
+/**
+  Erode with a disk.
+
+  @param[in,out] binary - the binary image
+  @param width - image width
+  @param height - image height
+  @param radius - disk radius
+  @returns 0 on success, -1 on out of memory.
+  @note Gives the same result as erode() with the structuring
+    element from sedisk(radius). Pixels off the image count as
+    background, as they do for erode().
+*/
+int erode_disk(unsigned char *binary, int width, int height, int radius)
+{
+  int *dt;
+  int i;
+
+  dt = edt_meijster(binary, width, height, 0, 1);
+  if(!dt)
+    return -1;
+  for(i=0;i<width*height;i++)
+    binary[i] = dt[i] >= radius * radius ? 1 : 0;
+  free(dt);
+
   return 0;
 }
 
@@ -239,3 +354,988 @@ error_exit:
    return 0;
 }
 
+/**
+  Meijster's linear time Euclidean distance transform.
+
+  @param[in] binary - the binary image
+  @param width - image width
+  @param height - image height
+  @param border - 0 if pixels off the image count as clear, 1 if set
+  @param Nthreads - number of threads to use
+  @returns Square of Euclidean distance transform, 0 on out of memory.
+  @note Set pixels get the squared distance to the nearest clear pixel,
+    clear pixels 0, the same as edt_saito(). If there is no clear pixel,
+    (border 1 and an all set image) the value is INT_MAX.
+    The columns are done first, a block of columns at a time sweeping
+    down the rows, so memory is read in order. Then each row is done
+    with a lower envelope of parabolas. Both phases are split between
+    the threads.
+
+   A. Meijster, J.B.T.M. Roerdink and W.H. Hesselink, "A general algorithm
+   for computing distance transforms in linear time", Mathematical
+   Morphology and its Applications to Image and Signal Processing,
+   pp. 331-340, 2000
+*/
+int *edt_meijster(unsigned char *binary, int width, int height, int border, int Nthreads)
+{
+  return separabledt(binary, width, height, DT_EUCLIDEAN, border, Nthreads);
+}
+
+/**
+  Meijster's Euclidean distance transform, as floats.
+
+  @param[in] binary - the binary image
+  @param width - image width
+  @param height - image height
+  @param border - 0 if pixels off the image count as clear, 1 if set
+  @param Nthreads - number of threads to use
+  @returns The Euclidean distance transform, 0 on out of memory.
+*/
+float *edt_meijsterf(unsigned char *binary, int width, int height, int border, int Nthreads)
+{
+  DTOPTIONS opt;
+
+  opt.metric = DT_EUCLIDEAN;
+  opt.output = DT_FLOAT;
+  opt.border = border ? DT_BORDER_FOREGROUND : DT_BORDER_BACKGROUND;
+  opt.Nthreads = Nthreads;
+
+  return distancetransform(binary, width, height, &opt);
+}
+
+/**
+  Distance transform.
+
+  @param[in] binary - the binary image
+  @param width - image width
+  @param height - image height
+  @param[in] opt - the options, 0 for squared Euclidean distance as int,
+    pixels off the image clear, one thread.
+  @returns The distance transform, int, float or unsigned short as
+    opt->output says (malloced), 0 on out of memory.
+  @note Set pixels get the distance to the nearest clear pixel, clear
+    pixels 0. The metrics are
+       DT_EUCLIDEAN - as int the squared distance, else the distance
+       DT_CHAMFER34 - orthogonal steps 3, diagonal 4. As int in those
+          units, else divided by 3
+       DT_CITYBLOCK - orthogonal steps only
+       DT_CHESSBOARD - diagonal steps count 1
+    The border policy says what is off the image:
+       DT_BORDER_BACKGROUND - clear pixels, so the image edge is a boundary
+       DT_BORDER_FOREGROUND - set pixels
+       DT_BORDER_IGNORE - nothing, distances are to clear pixels
+          in the image only.
+    Since only distances to clear pixels are measured, FOREGROUND and
+    IGNORE give the same result. A pixel with no clear pixel to measure
+    to gets INT_MAX, FLT_MAX, or 65535. unsigned short output is rounded
+    to the nearest integer and saturates at 65535.
+    Euclidean, city block and chessboard use Meijster's separable method
+    (see edt_meijster()) and run on opt->Nthreads threads. Chamfer 3-4 is
+    the two raster passes of chamfer34(), on one thread.
+*/
+void *distancetransform(unsigned char *binary, int width, int height, DTOPTIONS *opt)
+{
+  DTOPTIONS defaults = {DT_EUCLIDEAN, DT_INT, DT_BORDER_BACKGROUND, 1};
+  int *dt;
+  float *fdt;
+  unsigned short *udt;
+  double d;
+  int border;
+  int i;
+
+  if(!opt)
+    opt = &defaults;
+  border = opt->border == DT_BORDER_BACKGROUND ? 0 : 1;
+  if(opt->metric == DT_CHAMFER34)
+    dt = chamfer34dt(binary, width, height, border);
+  else
+    dt = separabledt(binary, width, height, opt->metric, border, opt->Nthreads);
+  if(!dt)
+    return 0;
+  if(opt->output == DT_INT)
+    return dt;
+
+  if(opt->output == DT_FLOAT)
+  {
+    fdt = malloc((size_t) width * height * sizeof(float) + 1);
+    if(fdt)
+      for(i=0;i<width*height;i++)
+      {
+        if(dt[i] == INT_MAX)
+          fdt[i] = FLT_MAX;
+        else if(opt->metric == DT_EUCLIDEAN)
+          fdt[i] = (float) sqrt((double) dt[i]);
+        else if(opt->metric == DT_CHAMFER34)
+          fdt[i] = dt[i] / 3.0f;
+        else
+          fdt[i] = (float) dt[i];
+      }
+    free(dt);
+    return fdt;
+  }
+
+  udt = malloc((size_t) width * height * sizeof(unsigned short) + 1);
+  if(udt)
+    for(i=0;i<width*height;i++)
+    {
+      if(dt[i] == INT_MAX)
+        d = 65535;
+      else if(opt->metric == DT_EUCLIDEAN)
+        d = sqrt((double) dt[i]);
+      else if(opt->metric == DT_CHAMFER34)
+        d = dt[i] / 3.0;
+      else
+        d = dt[i];
+      udt[i] = d >= 65534.5 ? 65535 : (unsigned short) (d + 0.5);
+    }
+  free(dt);
+  return udt;
+}
+
+/**
+  Signed distance field.
+
+  @param[in] binary - the binary image
+  @param width - image width
+  @param height - image height
+  @param subpixel - if set, put the edge half way between set and clear pixels
+  @param Nthreads - number of threads to use
+  @returns The field (malloced), 0 on out of memory.
+  @note Clear pixels get the Euclidean distance to the nearest set pixel,
+    set pixels minus the distance to the nearest clear pixel. Pixels off
+    the image count as clear. With subpixel, the distances are reduced
+    by a half, so the pixels either side of an edge get -0.5 and 0.5.
+    If there are no set pixels clear pixels get FLT_MAX.
+    The inside and outside distances are found together, one sweep
+    down the columns and one envelope pass along each row for each.
+*/
+float *signeddistancefield(unsigned char *binary, int width, int height, int subpixel, int Nthreads)
+{
+  return sdf(binary, width, height, subpixel, 0, 0.0, Nthreads);
+}
+
+/**
+  Quantised signed distance field, for textures.
+
+  @param[in] binary - the binary image
+  @param width - image width
+  @param height - image height
+  @param subpixel - if set, put the edge half way between set and clear pixels
+  @param bits - 8 for unsigned char output, 16 for unsigned short
+  @param scale - levels per pixel of distance
+  @param Nthreads - number of threads to use
+  @returns The field (malloced), 0 on out of memory or bad bits.
+  @note Each value is the signeddistancefield() value times scale, plus
+    128 (or 32768), rounded and clamped to the range of the type.
+*/
+void *signeddistancefieldq(unsigned char *binary, int width, int height, int subpixel, int bits, double scale, int Nthreads)
+{
+  if(bits != 8 && bits != 16)
+    return 0;
+  return sdf(binary, width, height, subpixel, bits, scale, Nthreads);
+}
+
+/**
+  Distance map for incremental updates.
+
+  @param[in] binary - the binary image
+  @param width - image width
+  @param height - image height
+  @param Nthreads - number of threads to use for full recomputes
+  @returns The map, 0 on out of memory.
+  @note The map keeps its own copy of the image, changed with
+    distancemap_update(). distancemap_get() gives the squared
+    Euclidean distance transform, the same as edt_meijster() with
+    pixels off the image clear.
+*/
+DISTANCEMAP *distancemap(unsigned char *binary, int width, int height, int Nthreads)
+{
+  DISTANCEMAP *dm;
+
+  dm = malloc(sizeof(DISTANCEMAP));
+  if(!dm)
+    return 0;
+  dm->width = width;
+  dm->height = height;
+  dm->Nthreads = Nthreads < 1 ? 1 : Nthreads;
+  dm->threshold = width * height / 64 + 1;
+  dm->binary = malloc((size_t) width * height + 1);
+  dm->g = malloc((size_t) width * height * sizeof(int) + 1);
+  dm->dt = calloc((size_t) width * height + 1, sizeof(int));
+  dm->dirty = malloc(height + 1);
+  dm->f = malloc(width * sizeof(int) + 1);
+  dm->s = malloc(width * sizeof(int) + 1);
+  dm->t = malloc(width * sizeof(int) + 1);
+  dm->d = malloc(width * sizeof(int) + 1);
+  if(!dm->binary || !dm->g || !dm->dt || !dm->dirty || !dm->f || !dm->s || !dm->t || !dm->d)
+    goto error_exit;
+  memcpy(dm->binary, binary, (size_t) width * height);
+  memset(dm->dirty, 0, height);
+  if(dm_recompute(dm))
+    goto error_exit;
+
+  return dm;
+error_exit:
+  killdistancemap(dm);
+  return 0;
+}
+
+/**
+  Distance map destructor.
+
+  @param dm - the map
+*/
+void killdistancemap(DISTANCEMAP *dm)
+{
+  if(dm)
+  {
+    free(dm->binary);
+    free(dm->g);
+    free(dm->dt);
+    free(dm->dirty);
+    free(dm->f);
+    free(dm->s);
+    free(dm->t);
+    free(dm->d);
+    free(dm);
+  }
+}
+
+/**
+  Get the distances from a distance map.
+
+  @param dm - the map
+  @returns The squared distance transform, width * height, owned by
+    the map and valid until the next update.
+*/
+int *distancemap_get(DISTANCEMAP *dm)
+{
+  return dm->dt;
+}
+
+/**
+  Set the batch size above which a distance map recomputes everything.
+
+  @param dm - the map
+  @param threshold - number of changed pixels
+  @note The default is one in 64 of the pixels.
+*/
+void distancemap_setthreshold(DISTANCEMAP *dm, int threshold)
+{
+  dm->threshold = threshold;
+}
+
+/**
+  Set and clear pixels in a distance map.
+
+  @param dm - the map
+  @param[in] x - x co-ordinates of the pixels
+  @param[in] y - y co-ordinates of the pixels
+  @param[in] values - new values, non-zero to set
+  @param N - number of pixels
+  @param[out] dirtyx - return for left of the changed distances
+  @param[out] dirtyy - return for top of the changed distances
+  @param[out] dirtywidth - return for width of the changed distances
+  @param[out] dirtyheight - return for height of the changed distances
+  @returns 0 on success, -1 on out of memory.
+  @note An edit only changes the vertical distances in its own column,
+    down to the nearest clear pixels above and below it, so only those
+    rows are run again. The rectangle is empty (zero width and height)
+    if no distance changed. If more pixels change than the threshold
+    the whole transform is recomputed and the rectangle is the image.
+    Pixels off the image are ignored.
+*/
+int distancemap_update(DISTANCEMAP *dm, int *x, int *y, unsigned char *values, int N,
+                       int *dirtyx, int *dirtyy, int *dirtywidth, int *dirtyheight)
+{
+  int width = dm->width;
+  int height = dm->height;
+  unsigned char value;
+  int Nchanged = 0;
+  int xmin = width, xmax = -1;
+  int ymin = height, ymax = -1;
+  int i;
+
+  for(i=0;i<N;i++)
+  {
+    if(x[i] < 0 || x[i] >= width || y[i] < 0 || y[i] >= height)
+      continue;
+    value = values[i] ? 1 : 0;
+    if(dm->binary[(size_t) y[i] * width + x[i]] == value)
+      continue;
+    dm->binary[(size_t) y[i] * width + x[i]] = value;
+    Nchanged++;
+  }
+
+  if(Nchanged > dm->threshold)
+  {
+    if(dm_recompute(dm))
+      return -1;
+    xmin = 0;
+    xmax = width - 1;
+    ymin = 0;
+    ymax = height - 1;
+  }
+  else if(Nchanged > 0)
+  {
+    for(i=0;i<N;i++)
+      if(x[i] >= 0 && x[i] < width && y[i] >= 0 && y[i] < height)
+        dm_column(dm, x[i], y[i]);
+    for(i=0;i<height;i++)
+    {
+      if(!dm->dirty[i])
+        continue;
+      dm->dirty[i] = 0;
+      if(dm_row(dm, i, dm->g, dm->dt, dm->f, dm->s, dm->t, dm->d, &xmin, &xmax))
+      {
+        if(i < ymin)
+          ymin = i;
+        ymax = i;
+      }
+    }
+  }
+
+  if(xmax < 0)
+    xmin = ymin = xmax = ymax = -1;
+  if(dirtyx)
+    *dirtyx = xmax < 0 ? 0 : xmin;
+  if(dirtyy)
+    *dirtyy = ymax < 0 ? 0 : ymin;
+  if(dirtywidth)
+    *dirtywidth = xmax - xmin + (xmax < 0 ? 0 : 1);
+  if(dirtyheight)
+    *dirtyheight = ymax - ymin + (ymax < 0 ? 0 : 1);
+
+  return 0;
+}
+
+/*
+  Signed distance field.
+  Params: binary - the binary image
+          width - image width
+          height - image height
+          subpixel - put the edge half way between pixels
+          bits - 0 for float, 8 or 16 for quantised
+          scale - levels per pixel, for quantised
+          Nthreads - number of threads
+  Returns: the field, 0 on out of memory.
+*/
+static void *sdf(unsigned char *binary, int width, int height, int subpixel, int bits, double scale, int Nthreads)
+{
+  SDF sd;
+  size_t elsize;
+  int Nbands;
+  int i;
+
+  sd.binary = binary;
+  sd.width = width;
+  sd.height = height;
+  sd.subpixel = subpixel;
+  sd.bits = bits;
+  sd.scale = scale;
+  if(Nthreads < 1)
+    Nthreads = 1;
+  sd.bandheight = (height + 2 * Nthreads - 1) / (2 * Nthreads);
+  if(sd.bandheight < 1)
+    sd.bandheight = 1;
+  Nbands = (height + sd.bandheight - 1) / sd.bandheight;
+  elsize = bits == 8 ? 1 : bits == 16 ? sizeof(unsigned short) : sizeof(float);
+  sd.gin = malloc((size_t) width * height * sizeof(int) + 1);
+  sd.gout = malloc((size_t) width * height * sizeof(int) + 1);
+  sd.out = malloc((size_t) width * height * elsize + 1);
+  sd.errors = malloc(Nbands * sizeof(int) + 1);
+  if(!sd.gin || !sd.gout || !sd.out || !sd.errors)
+    goto error_exit;
+
+  parallel_for((width + MEIJSTER_COLUMNS - 1) / MEIJSTER_COLUMNS, Nthreads, sdfcolumns, &sd);
+  parallel_for(Nbands, Nthreads, sdfrows, &sd);
+  for(i=0;i<Nbands;i++)
+    if(sd.errors[i])
+      goto error_exit;
+
+  free(sd.gin);
+  free(sd.gout);
+  free(sd.errors);
+  return sd.out;
+error_exit:
+  free(sd.gin);
+  free(sd.gout);
+  free(sd.out);
+  free(sd.errors);
+  return 0;
+}
+
+/*
+  signed distance field phase one, vertical distances to the nearest
+  clear and the nearest set pixel in one sweep each way.
+  Notes: -1 stands for none in the column. Off the image is clear.
+*/
+static void sdfcolumns(void *ptr, int block)
+{
+  SDF *sd = ptr;
+  unsigned char *row;
+  int *gin, *gout;
+  int width = sd->width;
+  int x0, x1;
+  int x, y;
+
+  x0 = block * MEIJSTER_COLUMNS;
+  x1 = x0 + MEIJSTER_COLUMNS < width ? x0 + MEIJSTER_COLUMNS : width;
+
+  for(y=0;y<sd->height;y++)
+  {
+    row = sd->binary + (size_t) y * width;
+    gin = sd->gin + (size_t) y * width;
+    gout = sd->gout + (size_t) y * width;
+    for(x=x0;x<x1;x++)
+    {
+      if(row[x])
+      {
+        gin[x] = y > 0 ? gin[x-width] + 1 : 1;
+        gout[x] = 0;
+      }
+      else
+      {
+        gin[x] = 0;
+        gout[x] = (y > 0 && gout[x-width] >= 0) ? gout[x-width] + 1 : -1;
+      }
+    }
+  }
+
+  for(y=sd->height-1;y>=0;y--)
+  {
+    gin = sd->gin + (size_t) y * width;
+    gout = sd->gout + (size_t) y * width;
+    for(x=x0;x<x1;x++)
+    {
+      if(gin[x])
+      {
+        if(y == sd->height - 1)
+          gin[x] = 1;
+        else if(gin[x+width] + 1 < gin[x])
+          gin[x] = gin[x+width] + 1;
+      }
+      else if(gout[x] && y < sd->height - 1 && gout[x+width] >= 0 &&
+              (gout[x] < 0 || gout[x+width] + 1 < gout[x]))
+        gout[x] = gout[x+width] + 1;
+    }
+  }
+}
+
+/*
+  signed distance field phase two, along a band of rows.
+*/
+static void sdfrows(void *ptr, int band)
+{
+  SDF *sd = ptr;
+  int width = sd->width;
+  int *s = 0;
+  int *t = 0;
+  int *f = 0;
+  int *din = 0;
+  int *dout = 0;
+  double d;
+  double half = sd->subpixel ? 0.5 : 0.0;
+  double mid = sd->bits == 8 ? 128.0 : 32768.0;
+  double top = sd->bits == 8 ? 255.0 : 65535.0;
+  int y0, y1;
+  int x, y;
+  int edge;
+  size_t i;
+
+  y0 = band * sd->bandheight;
+  y1 = y0 + sd->bandheight < sd->height ? y0 + sd->bandheight : sd->height;
+  s = malloc(width * sizeof(int) + 1);
+  t = malloc(width * sizeof(int) + 1);
+  f = malloc(width * sizeof(int) + 1);
+  din = malloc(width * sizeof(int) + 1);
+  dout = malloc(width * sizeof(int) + 1);
+  if(!s || !t || !f || !din || !dout)
+  {
+    sd->errors[band] = -1;
+    goto done;
+  }
+
+  for(y=y0;y<y1;y++)
+  {
+    envelope(DT_EUCLIDEAN, sd->gin + (size_t) y * width, din, width, f, s, t);
+    envelope(DT_EUCLIDEAN, sd->gout + (size_t) y * width, dout, width, f, s, t);
+    for(x=0;x<width;x++)
+    {
+      i = (size_t) y * width + x;
+      if(din[x])
+      {
+        edge = x + 1 < width - x ? x + 1 : width - x;
+        if(din[x] > edge * edge)
+          din[x] = edge * edge;
+        d = -(sqrt((double) din[x]) - half);
+      }
+      else if(dout[x] == INT_MAX)
+        d = FLT_MAX;
+      else
+        d = sqrt((double) dout[x]) - half;
+
+      if(sd->bits == 0)
+        ((float *) sd->out)[i] = (float) d;
+      else
+      {
+        d = d == FLT_MAX ? top : mid + d * sd->scale;
+        d = d < 0.0 ? 0.0 : d > top ? top : floor(d + 0.5);
+        if(sd->bits == 8)
+          ((unsigned char *) sd->out)[i] = (unsigned char) d;
+        else
+          ((unsigned short *) sd->out)[i] = (unsigned short) d;
+      }
+    }
+  }
+  sd->errors[band] = 0;
+
+done:
+  free(s);
+  free(t);
+  free(f);
+  free(din);
+  free(dout);
+}
+
+/*
+  Separable distance transform, Meijster's method.
+  Params: binary - the binary image
+          width - image width
+          height - image height
+          metric - DT_EUCLIDEAN, DT_CITYBLOCK or DT_CHESSBOARD
+          border - 0 if pixels off the image count as clear, 1 if set
+          Nthreads - number of threads
+  Returns: the distances as ints (squared for Euclidean), 0 on out of memory.
+*/
+static int *separabledt(unsigned char *binary, int width, int height, int metric, int border, int Nthreads)
+{
+  MEIJSTER mj;
+  int Nbands;
+  int i;
+
+  mj.binary = binary;
+  mj.width = width;
+  mj.height = height;
+  mj.metric = metric;
+  mj.border = border;
+  if(Nthreads < 1)
+    Nthreads = 1;
+  mj.bandheight = (height + 2 * Nthreads - 1) / (2 * Nthreads);
+  if(mj.bandheight < 1)
+    mj.bandheight = 1;
+  Nbands = (height + mj.bandheight - 1) / mj.bandheight;
+  mj.dt = malloc((size_t) width * height * sizeof(int) + 1);
+  mj.errors = malloc(Nbands * sizeof(int) + 1);
+  if(!mj.dt || !mj.errors)
+    goto error_exit;
+
+  parallel_for((width + MEIJSTER_COLUMNS - 1) / MEIJSTER_COLUMNS, Nthreads, meijstercolumns, &mj);
+  parallel_for(Nbands, Nthreads, meijsterrows, &mj);
+  for(i=0;i<Nbands;i++)
+    if(mj.errors[i])
+      goto error_exit;
+
+  free(mj.errors);
+  return mj.dt;
+error_exit:
+  free(mj.dt);
+  free(mj.errors);
+  return 0;
+}
+
+/*
+  edt_meijster() phase one, vertical distance to the nearest clear
+  pixel for a block of columns.
+  Notes: -1 stands for no clear pixel in the column.
+*/
+static void meijstercolumns(void *ptr, int block)
+{
+  MEIJSTER *mj = ptr;
+  unsigned char *row;
+  int *g, *below;
+  int width = mj->width;
+  int x0, x1;
+  int x, y;
+
+  x0 = block * MEIJSTER_COLUMNS;
+  x1 = x0 + MEIJSTER_COLUMNS < width ? x0 + MEIJSTER_COLUMNS : width;
+
+  /* down the rows */
+  for(y=0;y<mj->height;y++)
+  {
+    row = mj->binary + (size_t) y * width;
+    g = mj->dt + (size_t) y * width;
+    for(x=x0;x<x1;x++)
+    {
+      if(!row[x])
+        g[x] = 0;
+      else if(y > 0)
+        g[x] = g[x-width] < 0 ? -1 : g[x-width] + 1;
+      else
+        g[x] = mj->border ? -1 : 1;
+    }
+  }
+
+  /* and back up */
+  for(y=mj->height-1;y>=0;y--)
+  {
+    g = mj->dt + (size_t) y * width;
+    below = g + width;
+    for(x=x0;x<x1;x++)
+    {
+      if(g[x] == 0)
+        continue;
+      if(y < mj->height - 1)
+      {
+        if(below[x] >= 0 && (g[x] < 0 || below[x] + 1 < g[x]))
+          g[x] = below[x] + 1;
+      }
+      else if(!mj->border && (g[x] < 0 || g[x] > 1))
+        g[x] = 1;
+    }
+  }
+}
+
+/*
+  edt_meijster() phase two, combine the vertical distances along a
+  band of rows.
+  Notes: clear pixels off the ends of the row are handled afterwards,
+    they are always the nearest on their side.
+*/
+static void meijsterrows(void *ptr, int band)
+{
+  MEIJSTER *mj = ptr;
+  int width = mj->width;
+  int *g;
+  int *s = 0;
+  int *t = 0;
+  int *d = 0;
+  int *f = 0;
+  int y0, y1;
+  int x, y;
+  int edge;
+
+  y0 = band * mj->bandheight;
+  y1 = y0 + mj->bandheight < mj->height ? y0 + mj->bandheight : mj->height;
+  s = malloc(width * sizeof(int) + 1);
+  t = malloc(width * sizeof(int) + 1);
+  d = malloc(width * sizeof(int) + 1);
+  f = malloc(width * sizeof(int) + 1);
+  if(!s || !t || !d || !f)
+  {
+    mj->errors[band] = -1;
+    goto done;
+  }
+
+  for(y=y0;y<y1;y++)
+  {
+    g = mj->dt + (size_t) y * width;
+    envelope(mj->metric, g, d, width, f, s, t);
+    for(x=0;x<width;x++)
+    {
+      if(!mj->border)
+      {
+        edge = x + 1 < width - x ? x + 1 : width - x;
+        if(mj->metric == DT_EUCLIDEAN)
+          edge *= edge;
+        if(d[x] > edge)
+          d[x] = edge;
+      }
+      g[x] = d[x];
+    }
+  }
+  mj->errors[band] = 0;
+
+done:
+  free(s);
+  free(t);
+  free(d);
+  free(f);
+}
+
+/*
+  Distance along a row, from the vertical distances.
+  Params: metric - DT_EUCLIDEAN, DT_CITYBLOCK or DT_CHESSBOARD
+          g - vertical distance to nearest clear pixel, -1 for none
+          d - return for distances, INT_MAX for none
+          width - row width
+          f, s, t - workspace, width entries each
+  Notes: Euclidean and chessboard take the lower envelope of the
+    functions (x - i)^2 + g(i)^2 or max(|x - i|, g(i)) of the columns
+    i with a clear pixel. f holds g(i)^2 or g(i), s the columns on the
+    envelope, and t where each one takes over. City block is just a pass
+    each way.
+*/
+static void envelope(int metric, int *g, int *d, int width, int *f, int *s, int *t)
+{
+  int q = -1;
+  int x, i;
+  int sep;
+  int fq, fx;
+
+  if(metric == DT_CITYBLOCK)
+  {
+    for(x=0;x<width;x++)
+    {
+      d[x] = g[x] < 0 ? INT_MAX : g[x];
+      if(x > 0 && d[x-1] != INT_MAX && d[x-1] + 1 < d[x])
+        d[x] = d[x-1] + 1;
+    }
+    for(x=width-2;x>=0;x--)
+      if(d[x+1] != INT_MAX && d[x+1] + 1 < d[x])
+        d[x] = d[x+1] + 1;
+    return;
+  }
+
+  if(metric == DT_EUCLIDEAN)
+    for(x=0;x<width;x++)
+      f[x] = g[x] < 0 ? -1 : g[x] * g[x];
+  else
+    for(x=0;x<width;x++)
+      f[x] = g[x];
+
+  for(x=0;x<width;x++)
+  {
+    if(f[x] < 0)
+      continue;
+    while(q >= 0)
+    {
+      i = s[q];
+      if(metric == DT_EUCLIDEAN)
+      {
+        fq = (t[q] - i) * (t[q] - i) + f[i];
+        fx = (t[q] - x) * (t[q] - x) + f[x];
+      }
+      else
+      {
+        fq = abs(t[q] - i) > f[i] ? abs(t[q] - i) : f[i];
+        fx = abs(x - t[q]) > f[x] ? abs(x - t[q]) : f[x];
+      }
+      if(fq <= fx)
+        break;
+      q--;
+    }
+    if(q < 0)
+    {
+      q = 0;
+      s[0] = x;
+      t[0] = 0;
+      continue;
+    }
+    i = s[q];
+    if(metric == DT_EUCLIDEAN)
+      sep = (x * x - i * i + f[x] - f[i]) / (2 * (x - i));
+    else if(f[i] <= f[x])
+      sep = i + f[x] > (i + x) / 2 ? i + f[x] : (i + x) / 2;
+    else
+      sep = x - f[i] < (i + x) / 2 ? x - f[i] : (i + x) / 2;
+    if(sep + 1 < width)
+    {
+      q++;
+      s[q] = x;
+      t[q] = sep + 1;
+    }
+  }
+
+  /* read it off */
+  for(x=width-1;x>=0;x--)
+  {
+    if(q < 0)
+    {
+      d[x] = INT_MAX;
+      continue;
+    }
+    i = s[q];
+    if(metric == DT_EUCLIDEAN)
+      fx = (x - i) * (x - i) + f[i];
+    else
+      fx = abs(x - i) > f[i] ? abs(x - i) : f[i];
+    if(x == t[q])
+      q--;
+    d[x] = fx;
+  }
+}
+
+/*
+  Chamfer 3-4 distance transform, using the passes in chamfer34.c.
+  Params: binary - the binary image
+          width - image width
+          height - image height
+          border - 0 if pixels off the image count as clear, 1 if set
+  Returns: distances in chamfer units, 0 on out of memory.
+  Notes: the padding is squeezed out in place, rows only ever move down
+    the buffer.
+*/
+static int *chamfer34dt(unsigned char *binary, int width, int height, int border)
+{
+  int *dt;
+  int *shrunk;
+  int y;
+  size_t i;
+
+  dt = chamfer34padded(binary, width, height, border);
+  if(!dt)
+    return 0;
+  for(y=0;y<height;y++)
+    memmove(dt + (size_t) y * width, dt + (size_t) (y+1) * (width+2) + 1, width * sizeof(int));
+  for(i=0;i<(size_t) width * height;i++)
+    if(dt[i] >= INT_MAX - 10)
+      dt[i] = INT_MAX;
+
+  shrunk = realloc(dt, (size_t) width * height * sizeof(int) + 1);
+  return shrunk ? shrunk : dt;
+}
+
+/*
+  Recompute a distance map from scratch.
+  Params: dm - the map
+  Returns: 0 on success, -1 on out of memory.
+  Notes: the first phase is meijstercolumns() writing into the
+         vertical distances, which we keep for incremental updates.
+*/
+static int dm_recompute(DISTANCEMAP *dm)
+{
+  MEIJSTER mj;
+  DMBANDS db;
+  int Nbands;
+  int i;
+
+  mj.binary = dm->binary;
+  mj.width = dm->width;
+  mj.height = dm->height;
+  mj.metric = DT_EUCLIDEAN;
+  mj.border = 0;
+  mj.dt = dm->g;
+  parallel_for((dm->width + MEIJSTER_COLUMNS - 1) / MEIJSTER_COLUMNS, dm->Nthreads, meijstercolumns, &mj);
+
+  db.dm = dm;
+  db.bandheight = (dm->height + 2 * dm->Nthreads - 1) / (2 * dm->Nthreads);
+  if(db.bandheight < 1)
+    db.bandheight = 1;
+  Nbands = (dm->height + db.bandheight - 1) / db.bandheight;
+  db.errors = malloc(Nbands * sizeof(int) + 1);
+  if(!db.errors)
+    return -1;
+  parallel_for(Nbands, dm->Nthreads, dm_bandrows, &db);
+  for(i=0;i<Nbands;i++)
+    if(db.errors[i])
+      break;
+  free(db.errors);
+
+  return i < Nbands ? -1 : 0;
+}
+
+/*
+  distance map full recompute, rows job.
+*/
+static void dm_bandrows(void *ptr, int band)
+{
+  DMBANDS *db = ptr;
+  DISTANCEMAP *dm = db->dm;
+  int width = dm->width;
+  int *f, *s, *t, *d;
+  int xmin = width, xmax = -1;
+  int y0, y1;
+  int y;
+
+  y0 = band * db->bandheight;
+  y1 = y0 + db->bandheight < dm->height ? y0 + db->bandheight : dm->height;
+  f = malloc(width * sizeof(int) + 1);
+  s = malloc(width * sizeof(int) + 1);
+  t = malloc(width * sizeof(int) + 1);
+  d = malloc(width * sizeof(int) + 1);
+  if(f && s && t && d)
+  {
+    for(y=y0;y<y1;y++)
+      dm_row(dm, y, dm->g, dm->dt, f, s, t, d, &xmin, &xmax);
+    db->errors[band] = 0;
+  }
+  else
+    db->errors[band] = -1;
+  free(f);
+  free(s);
+  free(t);
+  free(d);
+}
+
+/*
+  Redo the vertical distances in a column around an edited pixel.
+  Params: dm - the map
+          x, y - the edited pixel
+  Notes: the distances change from the nearest clear pixel above the
+         edit to the nearest clear pixel below it, off the image
+         counting as clear. Rows that change are marked dirty.
+*/
+static void dm_column(DISTANCEMAP *dm, int x, int y)
+{
+  unsigned char *col = dm->binary + x;
+  int *g = dm->g + x;
+  int width = dm->width;
+  int ya, yb;
+  int i;
+  int gnew;
+
+  for(ya=y-1;ya>=0;ya--)
+    if(!col[(size_t) ya * width])
+      break;
+  for(yb=y+1;yb<dm->height;yb++)
+    if(!col[(size_t) yb * width])
+      break;
+
+  for(i=ya+1;i<yb;i++)
+  {
+    if(!col[(size_t) i * width])
+      gnew = 0;
+    else
+    {
+      gnew = i - ya < yb - i ? i - ya : yb - i;
+      if(!col[(size_t) y * width] && abs(i - y) < gnew)
+        gnew = abs(i - y);
+    }
+    if(g[(size_t) i * width] != gnew)
+    {
+      g[(size_t) i * width] = gnew;
+      dm->dirty[i] = 1;
+    }
+  }
+}
+
+/*
+  Compute one row of a distance map from the vertical distances.
+  Params: dm - the map
+          y - the row
+          g - vertical distances
+          dt - distance transform
+          f, s, t, d - workspaces, width ints each
+          xmin - in/out, leftmost changed distance
+          xmax - in/out, rightmost changed distance
+  Returns: 1 if any distance in the row changed, else 0.
+*/
+static int dm_row(DISTANCEMAP *dm, int y, int *g, int *dt, int *f, int *s, int *t, int *d, int *xmin, int *xmax)
+{
+  int width = dm->width;
+  int *row = dt + (size_t) y * width;
+  int edge;
+  int x;
+  int answer = 0;
+
+  envelope(DT_EUCLIDEAN, g + (size_t) y * width, d, width, f, s, t);
+  for(x=0;x<width;x++)
+  {
+    edge = x + 1 < width - x ? x + 1 : width - x;
+    if(d[x] > edge * edge)
+      d[x] = edge * edge;
+    if(row[x] != d[x])
+    {
+      row[x] = d[x];
+      if(x < *xmin)
+        *xmin = x;
+      if(x > *xmax)
+        *xmax = x;
+      answer = 1;
+    }
+  }
+
+  return answer;
+}
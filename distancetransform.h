@@ -1,7 +1,50 @@
 #ifndef distancetransform_h
 #define distancetransform_h
 
+/* metrics */
+#define DT_EUCLIDEAN 0
+#define DT_CHAMFER34 1
+#define DT_CITYBLOCK 2
+#define DT_CHESSBOARD 3
+
+/* outputs */
+#define DT_INT 0
+#define DT_FLOAT 1
+#define DT_UINT16 2
+
+/* what lies off the image */
+#define DT_BORDER_BACKGROUND 0
+#define DT_BORDER_FOREGROUND 1
+#define DT_BORDER_IGNORE 2
+
+/*
+  Options for distancetransform().
+*/
+typedef struct
+{
+  int metric;    /**< DT_EUCLIDEAN, DT_CHAMFER34, DT_CITYBLOCK or DT_CHESSBOARD */
+  int output;    /**< DT_INT, DT_FLOAT or DT_UINT16 */
+  int border;    /**< DT_BORDER_BACKGROUND, DT_BORDER_FOREGROUND or DT_BORDER_IGNORE */
+  int Nthreads;  /**< number of threads to use */
+} DTOPTIONS;
+
+typedef struct distancemap DISTANCEMAP;
+
+
 float *euclideandistancetransform(unsigned char *binary, int width, int height);
 int *edt_saito(unsigned char *binary, int width, int height);
+int *edt_meijster(unsigned char *binary, int width, int height, int border, int Nthreads);
+float *edt_meijsterf(unsigned char *binary, int width, int height, int border, int Nthreads);
+void *distancetransform(unsigned char *binary, int width, int height, DTOPTIONS *opt);
+float *signeddistancefield(unsigned char *binary, int width, int height, int subpixel, int Nthreads);
+void *signeddistancefieldq(unsigned char *binary, int width, int height, int subpixel, int bits, double scale, int Nthreads);
+DISTANCEMAP *distancemap(unsigned char *binary, int width, int height, int Nthreads);
+void killdistancemap(DISTANCEMAP *dm);
+int *distancemap_get(DISTANCEMAP *dm);
+void distancemap_setthreshold(DISTANCEMAP *dm, int threshold);
+int distancemap_update(DISTANCEMAP *dm, int *x, int *y, unsigned char *values, int N,
+                       int *dirtyx, int *dirtyy, int *dirtywidth, int *dirtyheight);
+int dilate_disk(unsigned char *binary, int width, int height, int radius);
+int erode_disk(unsigned char *binary, int width, int height, int radius);
 
 #endif
@@ -7,12 +7,29 @@
 //
 
 #include "featuretransform.h"
+#include "parallel.h"
 #include <stdlib.h>
 #include <string.h>
 
+// columns handled together by one job in round two
+#define FT_COLUMNS 32
 
-static int *processRows(unsigned char *binary, int width, int height);
-static int *processColumns(int *ftRow, int width, int height);
+typedef struct
+{
+    unsigned char *binary;  // the image
+    int width;              // image width
+    int height;             // image height
+    int bandheight;         // rows per job in round one
+    int Nbands;             // number of jobs in round one
+    int *ftRow;             // round one result, x of nearest feature in row
+    int *ft;                // [2][height][width] result, or null
+    unsigned int *packed;   // packed result, or null
+    int *errors;            // error return per job, round one then round two
+} FEATURETRANSFORM;
+
+static void *runtransform(unsigned char *binary, int width, int height, int packed, int Nthreads);
+static void processRows(void *ptr, int band);
+static void processColumns(void *ptr, int block);
 static int separation(int *ftRow, int width, int height, int iRow, int uRow, int colR2 );
 static int distance(int *ftRow, int width, int height, int xRow, int iRow, int colR2 );
 
@@ -22,33 +39,121 @@ static int distance(int *ftRow, int width, int height, int xRow, int iRow, int c
  
     Returns: feature transfrom [2][height][width] with rows
        in the first half of the buffer and columns in the second.
+       0 on out of memory.
  
  */
 int *featuretransform(unsigned char *binary, int width, int height)
 {
-    int *ftRow;
-    int *ft;
+    return runtransform(binary, width, height, 0, 1);
+}
+
+/**
+   multithreaded feature transform
+
+   @param[in] binary - the binary image
+   @param width - image width
+   @param height - image height
+   @param Nthreads - number of threads to use
+   @returns The transform in the same [2][height][width] layout as
+     featuretransform(), and identical to it, 0 on out of memory.
+ */
+int *featuretransform_mt(unsigned char *binary, int width, int height, int Nthreads)
+{
+    return runtransform(binary, width, height, 0, Nthreads);
+}
+
+/**
+   feature transform with packed co-ordinates
+
+   @param[in] binary - the binary image
+   @param width - image width
+   @param height - image height
+   @param Nthreads - number of threads to use
+   @returns One entry per pixel, (y << 16) | x of the nearest feature
+     pixel (see FT_X and FT_Y), or FT_NONE if the image has no set
+     pixels. 0 on out of memory or if either dimension is 65536 or more.
+   @note Half the memory of the two plane layout, and the x and y of a
+     pixel are in the same cache line.
+ */
+unsigned int *featuretransform_packed(unsigned char *binary, int width, int height, int Nthreads)
+{
+    if (width >= 65536 || height >= 65536)
+        return 0;
+    return runtransform(binary, width, height, 1, Nthreads);
+}
+
+
+// Round one in bands of rows, round two in blocks of columns,
+// each round spread over the threads
+static void *runtransform(unsigned char *binary, int width, int height, int packed, int Nthreads)
+{
+    FEATURETRANSFORM ft;
+    int Nbands, Nblocks;
+    int i;
+    
+    if (Nthreads < 1)
+        Nthreads = 1;
+    ft.binary = binary;
+    ft.width = width;
+    ft.height = height;
+    ft.bandheight = (height + 2 * Nthreads - 1) / (2 * Nthreads);
+    if (ft.bandheight < 1)
+        ft.bandheight = 1;
+    Nbands = (height + ft.bandheight - 1) / ft.bandheight;
+    ft.Nbands = Nbands;
+    Nblocks = (width + FT_COLUMNS - 1) / FT_COLUMNS;
+    ft.ft = 0;
+    ft.packed = 0;
+    ft.ftRow = malloc((size_t) width * height * sizeof(int) + 1);
+    ft.errors = malloc((Nbands + Nblocks) * sizeof(int) + 1);
+    if (packed)
+        ft.packed = malloc((size_t) width * height * sizeof(unsigned int) + 1);
+    else
+        ft.ft = malloc(2 * (size_t) width * height * sizeof(int) + 1);
+    if (!ft.ftRow || !ft.errors || (!ft.ft && !ft.packed))
+        goto error_exit;
     
-    ftRow = processRows(binary, width, height);
-    ft = processColumns(ftRow, width, height);
+    parallel_for(Nbands, Nthreads, processRows, &ft);
+    for (i = 0; i < Nbands; i++)
+        if (ft.errors[i])
+            goto error_exit;
+    parallel_for(Nblocks, Nthreads, processColumns, &ft);
+    for (i = 0; i < Nblocks; i++)
+        if (ft.errors[Nbands + i])
+            goto error_exit;
     
-    return ft;
+    free(ft.ftRow);
+    free(ft.errors);
+    return packed ? (void *) ft.packed : (void *) ft.ft;
+error_exit:
+    free(ft.ftRow);
+    free(ft.errors);
+    free(ft.ft);
+    free(ft.packed);
+    return 0;
 }
 
 
-
 // Algorithm in two rounds; round one: along rows
-static int *processRows(unsigned char *binary, int width, int height) {
-    // feature transform array - row only
-    int *ftRow = malloc(width * height * sizeof(int));
+static void processRows(void *ptr, int band) {
+    FEATURETRANSFORM *ft = ptr;
+    unsigned char *binary = ft->binary;
+    int width = ft->width;
+    int height = ft->height;
+    int *ftRow = ft->ftRow;
+    int row0 = band * ft->bandheight;
+    int row1 = row0 + ft->bandheight < height ? row0 + ft->bandheight : height;
     
     // temporary column distance array
-    int *rowDist = malloc(width * sizeof(int));
-    memset(rowDist, 0, width * sizeof(int));
+    int *rowDist = malloc(width * sizeof(int) + 1);
+    if (!rowDist) {
+        ft->errors[band] = -1;
+        return;
+    }
     
-    for ( int row=0; row<height; row++ )
+    for ( int row=row0; row<row1; row++ )
     {
-        int startRow = row*width;
+        size_t startRow = (size_t) row*width;
         // Count distance from right boundary
         if ( binary[startRow+width-1] ) {
             rowDist[width-1] = 0;
@@ -74,55 +179,91 @@ static int *processRows(unsigned char *binary, int width, int height) {
         }
     }
     free(rowDist);
-    return ftRow;
+    ft->errors[band] = 0;
 }
 
 
 // Algorithm in two rounds; round two: along cols
-static int *processColumns(int *ftRow, int width, int height)
+// A block of columns goes down the image together, so each row of
+// ftRow is read contiguously rather than one int per cache line.
+static void processColumns(void *ptr, int block)
 {
-    int *ft = malloc(2 * width * height * sizeof(int));
-    int *seg = malloc( (height + 1) * sizeof(int)); // s
-    int *val = malloc( (height + 1) * sizeof(int)); // t
-    int idSeg; // q
-    memset(seg, 0, (height +1) * sizeof(int));
-    memset(val, 0, (height+1) * sizeof(int));
-    for (int colR2=0; colR2 < width; colR2++ ) {
-        idSeg = 0;
-        seg[0] = 0;
-        val[0] = 0;
-        
-        for ( int u=1; u < height; u++ ) {
-            while ( idSeg >= 0 &&
-                   distance(ftRow, width, height, val[idSeg],seg[idSeg], colR2) >
-                   distance(ftRow, width, height, val[idSeg],u, colR2)) {
-                --idSeg;
+    FEATURETRANSFORM *ft = ptr;
+    int width = ft->width;
+    int height = ft->height;
+    int *ftRow = ft->ftRow;
+    int col0 = block * FT_COLUMNS;
+    int ncols = col0 + FT_COLUMNS < width ? FT_COLUMNS : width - col0;
+    int idSeg[FT_COLUMNS]; // q
+    
+    int *seg = malloc( (size_t) (height + 1) * ncols * sizeof(int)); // s
+    int *val = malloc( (size_t) (height + 1) * ncols * sizeof(int)); // t
+    if (!seg || !val) {
+        free(seg);
+        free(val);
+        ft->errors[ft->Nbands + block] = -1;
+        return;
+    }
+    
+    for (int c=0; c < ncols; c++) {
+        idSeg[c] = 0;
+        seg[(size_t) c * (height + 1)] = 0;
+        val[(size_t) c * (height + 1)] = 0;
+    }
+    for ( int u=1; u < height; u++ ) {
+        for (int c=0; c < ncols; c++) {
+            int colR2 = col0 + c;
+            int *cseg = seg + (size_t) c * (height + 1);
+            int *cval = val + (size_t) c * (height + 1);
+            int q = idSeg[c];
+            
+            while ( q >= 0 &&
+                   distance(ftRow, width, height, cval[q],cseg[q], colR2) >
+                   distance(ftRow, width, height, cval[q],u, colR2)) {
+                --q;
             }
-            if ( idSeg < 0 ) {
-                idSeg = 0;
-                seg[idSeg] = u; // set current index to be first
+            if ( q < 0 ) {
+                q = 0;
+                cseg[q] = u; // set current index to be first
             } else {
-                int curVal = 1 + separation(ftRow, width, height, seg[idSeg],u, colR2);
+                int curVal = 1 + separation(ftRow, width, height, cseg[q],u, colR2);
                 // Check if current segment becomes minimal inside image
                 if ( curVal < height ) {
                     // Update for current segment
-                    ++idSeg;
-                    seg[idSeg] = u;
-                    val[idSeg] = curVal;
+                    ++q;
+                    cseg[q] = u;
+                    cval[q] = curVal;
                 }
             }
+            idSeg[c] = q;
         }
-        for ( int u=height-1; u>=0; u-- ) {
-            ft[0*width*height+u*width+colR2] =
-            ftRow[seg[idSeg]*width+colR2];
-            ft[1*width*height+u*width+colR2] = seg[idSeg];
+    }
+    for ( int u=height-1; u>=0; u-- ) {
+        for (int c=0; c < ncols; c++) {
+            int colR2 = col0 + c;
+            int *cseg = seg + (size_t) c * (height + 1);
+            int *cval = val + (size_t) c * (height + 1);
+            size_t pos = (size_t) u*width+colR2;
+            int x = ftRow[(size_t) cseg[idSeg[c]]*width+colR2];
+            
+            if (ft->packed) {
+                if (x >= 0 && x < width)
+                    ft->packed[pos] = ((unsigned int) cseg[idSeg[c]] << 16) | (unsigned int) x;
+                else
+                    ft->packed[pos] = FT_NONE;
+            } else {
+                ft->ft[pos] = x;
+                ft->ft[(size_t) width*height+pos] = cseg[idSeg[c]];
+            }
             // Reached next segment?
-            if ( u==val[idSeg] ) {
-                --idSeg;
+            if ( u==cval[idSeg[c]] ) {
+                --idSeg[c];
             }
         }
     }
-    return ft;
+    free(seg);
+    free(val);
+    ft->errors[ft->Nbands + block] = 0;
 }
 
 
@@ -131,8 +272,8 @@ static int *processColumns(int *ftRow, int width, int height)
 static int separation(int *ftRow, int width, int height, int iRow, int uRow, int colR2 )
 {
     if ( uRow - iRow == 0 ) return 0;
-    int iRowDist = colR2-ftRow[iRow*width+colR2];
-    int uRowDist = colR2-ftRow[uRow*width+colR2];
+    int iRowDist = colR2-ftRow[(size_t) iRow*width+colR2];
+    int uRowDist = colR2-ftRow[(size_t) uRow*width+colR2];
     return ((uRow*uRow-iRow*iRow
              + uRowDist*uRowDist - iRowDist*iRowDist)/
             (2*(uRow-iRow)));
@@ -144,10 +285,9 @@ static int separation(int *ftRow, int width, int height, int iRow, int uRow, int
 static int distance(int *ftRow, int width, int height, int xRow, int iRow, int colR2 ) {
     int rowDist = 0;
 
-    rowDist = colR2 - ftRow[iRow*width+colR2];
+    rowDist = colR2 - ftRow[(size_t) iRow*width+colR2];
 
     
     return (xRow-iRow)*(xRow-iRow)
     + rowDist*rowDist;
 }
-
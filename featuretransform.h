@@ -8,5 +8,14 @@
 
 #ifndef featuretransform_h
 #define featuretransform_h
+
+// packed feature transform entries, (y << 16) | x, so both dimensions
+// must be under 65536 for FT_NONE never to be a real pixel
+#define FT_NONE 0xFFFFFFFFu
+#define FT_X(p) ((int) ((p) & 0xFFFF))
+#define FT_Y(p) ((int) ((p) >> 16))
+
 int *featuretransform(unsigned char *binary, int width, int height);
+int *featuretransform_mt(unsigned char *binary, int width, int height, int Nthreads);
+unsigned int *featuretransform_packed(unsigned char *binary, int width, int height, int Nthreads);
 #endif /* featuretransform_h */
@@ -0,0 +1,171 @@
+/**@file
+   Geodesic distance transform.
+
+   The distance from a set of seeds to every pixel, travelling only
+   through set pixels of a mask. Steps are chamfer 3-4, 3 for a move
+   to a 4-neighbour and 4 for a diagonal move, so the distances are
+   about three times the Euclidean path length.
+
+   Because the steps are small integers we can use Dial's bucket queue
+   rather than a heap. Every pixel in the queue has a distance within 4
+   of the current one, so five buckets in a ring hold them all, and
+   taking the next pixel is constant time. The whole transform is
+   linear in the number of mask pixels, so it replaces any number of
+   point to point searches with astar().
+
+   By Malcolm McLean.
+*/
+#include <stdlib.h>
+#include <limits.h>
+
+#include "geodesic.h"
+
+#define NBUCKETS 5
+
+typedef struct
+{
+  int *pix;     /* pixel indices */
+  int N;        /* number in the bucket */
+  int capacity; /* allocated size */
+} BUCKET;
+
+static int push(BUCKET *bucket, int pix);
+
+/**
+  Geodesic distance transform.
+
+  @param[in] mask - the binary image, set pixels may be travelled through
+  @param width - image width
+  @param height - image height
+  @param[in] seedx - x co-ordinates of the seeds
+  @param[in] seedy - y co-ordinates of the seeds
+  @param Nseeds - number of seeds
+  @param[out] labels - return for the index of the nearest seed of each
+     pixel (may be null)
+  @returns The chamfer 3-4 distance along the shortest path in the mask
+     from the nearest seed, -1 for pixels which are clear or which
+     no seed can reach. 0 on out of memory.
+  @note Seeds on clear pixels or off the image are ignored. Moves are
+     8-connected. Where two seeds are the same distance away, the one
+     which got there first, usually the earlier in the list, wins.
+     Unreached pixels get label -1.
+*/
+int *geodesicdistance(unsigned char *mask, int width, int height, int *seedx, int *seedy, int Nseeds, int **labels)
+{
+  static const int dx[8] = {-1, 0, 1, -1, 1, -1, 0, 1};
+  static const int dy[8] = {-1, -1, -1, 0, 0, 1, 1, 1};
+  static const int step[8] = {4, 3, 4, 3, 3, 4, 3, 4};
+  BUCKET bucket[NBUCKETS] = {{0}};
+  BUCKET *b;
+  int *dist = 0;
+  int *label = 0;
+  int Nqueued = 0;
+  int current;
+  int pix, target;
+  int x, y, tx, ty;
+  int nd;
+  int i, ii;
+
+  dist = malloc((size_t) width * height * sizeof(int) + 1);
+  if(!dist)
+    goto out_of_memory;
+  if(labels)
+  {
+    label = malloc((size_t) width * height * sizeof(int) + 1);
+    if(!label)
+      goto out_of_memory;
+    for(i=0;i<width*height;i++)
+      label[i] = -1;
+  }
+  for(i=0;i<width*height;i++)
+    dist[i] = INT_MAX;
+
+  for(i=0;i<Nseeds;i++)
+  {
+    if(seedx[i] < 0 || seedx[i] >= width || seedy[i] < 0 || seedy[i] >= height)
+      continue;
+    pix = seedy[i] * width + seedx[i];
+    if(!mask[pix] || dist[pix] == 0)
+      continue;
+    dist[pix] = 0;
+    if(label)
+      label[pix] = i;
+    if(push(&bucket[0], pix))
+      goto out_of_memory;
+    Nqueued++;
+  }
+
+  for(current = 0; Nqueued > 0; current++)
+  {
+    b = &bucket[current % NBUCKETS];
+    /* steps are 3 or 4, so nothing is added to this bucket while we empty it */
+    for(ii=0;ii<b->N;ii++)
+    {
+      pix = b->pix[ii];
+      if(dist[pix] != current)
+        continue;
+      x = pix % width;
+      y = pix / width;
+      for(i=0;i<8;i++)
+      {
+        tx = x + dx[i];
+        ty = y + dy[i];
+        if(tx < 0 || tx >= width || ty < 0 || ty >= height)
+          continue;
+        target = ty * width + tx;
+        nd = current + step[i];
+        if(!mask[target] || dist[target] <= nd)
+          continue;
+        dist[target] = nd;
+        if(label)
+          label[target] = label[pix];
+        if(push(&bucket[nd % NBUCKETS], target))
+          goto out_of_memory;
+        Nqueued++;
+      }
+    }
+    Nqueued -= b->N;
+    b->N = 0;
+  }
+
+  for(i=0;i<width*height;i++)
+    if(dist[i] == INT_MAX)
+      dist[i] = -1;
+  for(i=0;i<NBUCKETS;i++)
+    free(bucket[i].pix);
+  if(labels)
+    *labels = label;
+  return dist;
+
+out_of_memory:
+  for(i=0;i<NBUCKETS;i++)
+    free(bucket[i].pix);
+  free(dist);
+  free(label);
+  if(labels)
+    *labels = 0;
+  return 0;
+}
+
+/*
+  Add a pixel to a bucket.
+  Params: bucket - the bucket
+          pix - the pixel index
+  Returns: 0 on success, -1 on out of memory.
+*/
+static int push(BUCKET *bucket, int pix)
+{
+  int *temp;
+
+  if(bucket->N == bucket->capacity)
+  {
+    temp = realloc(bucket->pix, (bucket->capacity * 2 + 64) * sizeof(int));
+    if(!temp)
+      return -1;
+    bucket->pix = temp;
+    bucket->capacity = bucket->capacity * 2 + 64;
+  }
+  bucket->pix[bucket->N++] = pix;
+
+  return 0;
+}
@@ -0,0 +1,6 @@
+#ifndef geodesic_h
+#define geodesic_h
+
+int *geodesicdistance(unsigned char *mask, int width, int height, int *seedx, int *seedy, int Nseeds, int **labels);
+
+#endif
@@ -3,10 +3,11 @@ Binary Hausdorff routine
 */
 
 #include <stdlib.h>
-#include <string.h>
+#include <limits.h>
 
+#include "distancetransform.h"
 
-static int dilate(unsigned char *binary, int width, int height, unsigned char *sel, int swidth, int sheight);
+static int halfhausdorff(unsigned char *from, unsigned char *to, int width, int height);
 
 /**
   Binary Hausdorff distance.
@@ -24,64 +25,32 @@ static int dilate(unsigned char *binary, int width, int height, unsigned char *s
   @param[out] halfa - return for half-Hausdorff distance a to b
   @param[out] halfb - return for half-Hausdorff distance b to a
   @returns The Hausdorff distance between image a and image b.
-  @note Diagonal steps = 1, not Euclidean distance.
+  @note Diagonal steps = 1, not Euclidean distance, so the half distances
+    are the largest chessboard distance transform values.
   @note return -1 if either image empty.
 */
 int binaryhausdorff(unsigned char *imagea, unsigned char *imageb, int width, int height, int *halfa, int *halfb)
 {
-	unsigned char *buff;
-	unsigned char se[9] = { 1,1,1,1,1,1,1,1,1 };
-	int maxit;
 	int halfda = -1;
 	int halfdb = -1;
 	int answer;
-	int i, ii;
 
-	buff = malloc(width * height);
-	if (!buff)
+	halfdb = halfhausdorff(imageb, imagea, width, height);
+	if (halfdb == -2)
+		goto out_of_memory;
+	halfda = halfhausdorff(imagea, imageb, width, height);
+	if (halfda == -2)
 		goto out_of_memory;
-
-	maxit = width > height ? width : height;
-
-	memcpy(buff, imagea, width * height);
-	for (i = 0; i < maxit; i++)
-	{
-		
-		for (ii = 0; ii < width*height; ii++)
-			if (imageb[ii] && !buff[ii])
-				break;
-		if (ii == width * height)
-		{
-			halfdb = i;
-			break;
-		}
-		dilate(buff, width, height, se, 3, 3);
-	}
-	memcpy(buff, imageb, width * height);
-	for (i = 0; i < maxit; i++)
-	{
-		for (ii = 0; ii < width*height; ii++)
-			if (imagea[ii] && !buff[ii])
-				break;
-		if (ii == width * height)
-		{
-			halfda = i;
-			break;
-		}
-		dilate(buff, width, height, se, 3, 3);
-	}
 
 	if (halfda == -1 || halfdb == -1)
 		answer = -1;
 	else
 		answer = halfda > halfdb ? halfda : halfdb;
 
-
 	if (halfa)
 		*halfa = halfda;
 	if (halfb)
 		*halfb = halfdb;
-	free(buff);
 	return answer;
 
 out_of_memory:
@@ -89,59 +58,56 @@ out_of_memory:
 		*halfa = -1;
 	if (halfb)
 		*halfb = -1;
-	free(buff);
 	return -1;
 }
 
 /*
-Dilate operation.
+half-Hausdorff distance.
 
-@param[in,out] bianry - the binary image
+@param[in] from - the pixels to measure from
+@param[in] to - the pixels to measure to
 @param width - image width
 @param height - image height
-@param sel[in] - the selection element
-@param swidth - selection element width
-@param sheight - selection element height
-@returns 0 on sucess, -1 on error.
-
+@returns maximum chessboard distance from a set pixel of from to the
+   nearest set pixel of to, 0 if from is empty, -1 if to is empty
+   and from is not, -2 on out of memory.
 */
-static int dilate(unsigned char *binary, int width, int height, unsigned char *sel, int swidth, int sheight)
+static int halfhausdorff(unsigned char *from, unsigned char *to, int width, int height)
 {
-	int x, y, sx, sy, ix, iy;
-	unsigned char *answer;
+	unsigned char *inverted;
+	int *dt;
+	DTOPTIONS opt;
+	int answer = 0;
 	int i;
-	int bit;
 
-	answer = malloc(width * height);
-	if (!answer)
-		return -1;
-
-	for (i = 0; i<width*height; i++)
-		answer[i] = 0;
-
-	for (y = 0; y<height; y++)
-		for (x = 0; x<width; x++)
+	inverted = malloc(width * height);
+	if (!inverted)
+		return -2;
+	for (i = 0; i < width*height; i++)
+		inverted[i] = to[i] ? 0 : 1;
+
+	opt.metric = DT_CHESSBOARD;
+	opt.output = DT_INT;
+	opt.border = DT_BORDER_IGNORE;
+	opt.Nthreads = 1;
+	dt = distancetransform(inverted, width, height, &opt);
+	free(inverted);
+	if (!dt)
+		return -2;
+
+	for (i = 0; i < width*height; i++)
+	{
+		if (from[i] && dt[i] > answer)
 		{
-			for (sy = 0; sy<sheight; sy++)
-				for (sx = 0; sx < swidth; sx++)
-				{
-					ix = x + sx - swidth / 2;
-					iy = y + sy - sheight / 2;
-					if (ix < 0 || ix >= width || iy < 0 || iy >= height)
-						bit = 0;
-					else
-						bit = binary[iy * width + ix];
-					if (bit == 1 && sel[sy*swidth + sx] == 1)
-					{
-						answer[y*width + x] = 1;
-					}
-				}
+			if (dt[i] == INT_MAX)
+			{
+				answer = -1;
+				break;
+			}
+			answer = dt[i];
 		}
-	for (i = 0; i<width*height; i++)
-		binary[i] = answer[i];
-	free(answer);
-
-	return 0;
-
+	}
+	free(dt);
 
+	return answer;
 }
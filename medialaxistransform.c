@@ -10,11 +10,31 @@
 #include <string.h>
 #include <math.h>
 
-static float *euclideandistancetransform(unsigned char *binary, int width, int height);
-static int *edt_saito(unsigned char *binary, int width, int height);
+#include "distancetransform.h"
+#include "featuretransform.h"
+#include "parallel.h"
 
-void thin(unsigned char *binary, int width, int height);
+typedef struct
+{
+	unsigned char *binary;	/* the image */
+	int width;		/* image width */
+	int height;		/* image height */
+	int minsep2;		/* squared separation of feature points needed */
+	unsigned int *ft;	/* feature transform of the bordered background */
+	int bandheight;		/* rows per job */
+	unsigned char *skel;	/* binary output, or null */
+	float *dist;		/* distance output, or null */
+} INTEGERMA;
+
+static int *bordereddt(unsigned char *bordered, int width, int height);
+static int integermedialaxis_run(unsigned char *binary, int width, int height, int minsep2, int Nthreads,
+	unsigned char *skel, float *dist);
+static void integermedialaxis_band(void *ptr, int band);
+static int integermedialaxis_pair(unsigned int fp, unsigned int fq, int px, int py, int qx, int qy, int minsep2);
+
+int thin(unsigned char *binary, int width, int height);
 static int thin_pass(unsigned char *binary, int width, int height, unsigned char *out, int pass);
+static int neighbourmap(unsigned char *image, int width, int height, int x, int y);
 static void get3x3(unsigned char *out, unsigned char *img, int width, int height, int x, int y, unsigned char border);
 
 /**
@@ -53,7 +73,7 @@ float *medialaxistransformf(unsigned char *binary, int width, int height)
 		bordered[y*(width + 2) + width + 1] = 0;
 	}
 
-	dt = edt_saito(bordered, width + 2, height + 2);
+	dt = bordereddt(bordered, width + 2, height + 2);
 	if (!dt)
 		goto error_exit;
 
@@ -81,11 +101,12 @@ float *medialaxistransformf(unsigned char *binary, int width, int height)
 			bordered[y*(width + 2) + x] = 0;
 
 		}
-	thin(bordered, width + 2, height + 2);
+	if (thin(bordered, width + 2, height + 2))
+		goto error_exit;
 	for (y = 0; y < height; y++)
 		for (x = 0; x < width; x++)
-			if (bordered[y*(width + 2) + x])
-				answer[y*width + x] = sqrt(dt[y*width + x]);
+			if (bordered[(y + 1)*(width + 2) + x + 1])
+				answer[y*width + x] = sqrt(dt[(y + 1)*(width + 2) + x + 1]);
 			else
 				answer[y*width + x] = 0;
 
@@ -136,7 +157,7 @@ unsigned char *medialaxistransform(unsigned char *binary, int width, int height)
 		bordered[y*(width + 2) + width + 1] = 0;
 	}
 
-	dt = edt_saito(bordered, width + 2, height + 2);
+	dt = bordereddt(bordered, width + 2, height + 2);
 	if (!dt)
 		goto error_exit;
 
@@ -165,7 +186,8 @@ unsigned char *medialaxistransform(unsigned char *binary, int width, int height)
 			bordered[y*(width + 2) + x] = 0;
 		
 		}
-	thin(bordered, width + 2, height + 2);
+	if (thin(bordered, width + 2, height + 2))
+		goto error_exit;
 	for (y = 0; y < height; y++)
 		for (x = 0; x < width; x++)
 			answer[y*width + x] = bordered[(y+1)*(width+2)+x+1];
@@ -182,222 +204,200 @@ error_exit:
 	return 0;
 }
 
-/*
-gift-wraps edt_saito.
-The function doesn't handle the case where set pixels touch the border
-Also, it returns the square of the distnace as an integer
+/**
+  Integer medial axis.
+
+  @param[in] binary - the binary image
+  @param width - image width
+  @param height - image height
+  @param minsep2 - squared distance feature points must be apart, 1 for
+    the full axis, more to prune the branches from small boundary bumps
+  @param Nthreads - number of threads to use
+  @returns The medial axis (malloced), 0 on out of memory.
+  @note Hesselink and Roerdink's integer medial axis, straight from the
+    feature transform of the background, with pixels off the image
+    as background. Each pair of 4-neighbours whose nearest background
+    pixels are far enough apart puts whichever is nearer the bisector
+    on the axis. There is no thinning pass, and each pixel is decided
+    on its own, so the rows go on separate threads.
 */
-static float *euclideandistancetransform(unsigned char *binary, int width, int height)
+unsigned char *integermedialaxis(unsigned char *binary, int width, int height, int minsep2, int Nthreads)
 {
-	unsigned char *bordered = 0;
-	int *dt = 0;
-	float *answer = 0;
-	int x, y;
+	unsigned char *answer;
 
-	bordered = malloc((width + 2) * (height + 2));
-	if (!bordered)
-		goto error_exit;
-
-	for (y = 0; y<height; y++)
-		for (x = 0; x<width; x++)
-			bordered[(y + 1)* (width + 2) + x + 1] = binary[y*width + x];
-
-	for (x = 0; x<width + 2; x++)
-	{
-		bordered[x] = 0;
-		bordered[(height + 1)*(width + 2) + x] = 0;
-	}
-	for (y = 0; y<height + 2; y++)
+	answer = malloc(width * height + 1);
+	if (!answer)
+		return 0;
+	if (integermedialaxis_run(binary, width, height, minsep2, Nthreads, answer, 0))
 	{
-		bordered[y*(width + 2)] = 0;
-		bordered[y*(width + 2) + width + 1] = 0;
+		free(answer);
+		return 0;
 	}
+	return answer;
+}
 
-	dt = edt_saito(bordered, width + 2, height + 2);
-	if (!dt)
-		goto error_exit;
+/**
+  Integer medial axis, retaining distance to perimeter.
+
+  @param[in] binary - the binary image
+  @param width - image width
+  @param height - image height
+  @param minsep2 - squared distance feature points must be apart
+  @param Nthreads - number of threads to use
+  @returns The Euclidean distance to the background on the axis, 0
+    elsewhere (malloced), 0 on out of memory.
+  @note See integermedialaxis().
+*/
+float *integermedialaxisf(unsigned char *binary, int width, int height, int minsep2, int Nthreads)
+{
+	float *answer;
 
-	answer = malloc(width * height * sizeof(float));
+	answer = malloc(width * height * sizeof(float) + 1);
 	if (!answer)
-		goto error_exit;
-
-	for (y = 0; y<height; y++)
-		for (x = 0; x<width; x++)
-			answer[y*width + x] = (float)sqrt(dt[(y + 1)*(width + 2) + x + 1]);
-
-	free(dt);
-	free(bordered);
+		return 0;
+	if (integermedialaxis_run(binary, width, height, minsep2, Nthreads, 0, answer))
+	{
+		free(answer);
+		return 0;
+	}
 	return answer;
-error_exit:
-	free(bordered);
-	free(dt);
-	free(answer);
-	return 0;
 }
 
 /*
-* Final implementation by R. Fabbri,
-* based on two independent implementations by O. Cuisenaire
-* and J. C. Torelli.
-*
-* PAPER
-*    T. Saito and J.I. Toriwaki, "New algorithms for Euclidean distance
-*    transformations of an n-dimensional digitised picture with applications",
-*    Pattern Recognition, 27(11), pp. 1551-1565, 1994
-*
-* A nice overview of Saito's method may be found at:
-*    Chapter 2 of "Distance transformations: fast algorithms and applications
-*    to medical image processing", Olivier Cuisenaire's Ph.D. Thesis, October
-*    1999, Université catholique de Louvain, Belgium.
-*
-*
+  Integer medial axis.
+  Params: binary - the binary image
+          width - image width
+          height - image height
+          minsep2 - squared separation of feature points
+          Nthreads - number of threads
+          skel - binary output, or null
+          dist - distance output, or null
+  Returns: 0 on success, -1 on out of memory.
 */
-static int *edt_saito(unsigned char *binary, int width, int height)
+static int integermedialaxis_run(unsigned char *binary, int width, int height, int minsep2, int Nthreads,
+	unsigned char *skel, float *dist)
 {
-	int i, j, l, a, b, m, buffer, nsqr, diag1,
-		*ptstart, *ptend, *sq, *df2, *buff, *pt, *npt;
-
-	int *map = 0;
-	sq = 0;
-	buff = 0;
-
-
-	map = malloc(width * height * sizeof(int));
-	if (!map)
-		goto error_exit;
-	for (i = 0; i<width*height; i++)
-		map[i] = binary[i];
-
-
-	/* this is >= the diagonal minus 1 */
-	diag1 = (int)ceil(sqrt((width - 1)*(width - 1) + (height - 1)*(height - 1))) - 1;
-
-	/* Cuisenaire's idea: a LUT with precomputed i*i */
-	nsqr = 2 * (diag1 + 1);   /* was: 2*r + 2 in Cuisenaire's code */
-	sq = malloc(nsqr * sizeof(int));
-	if (!sq)
-		goto error_exit;
-	for (i = 0; i<nsqr; i++)
-		sq[i] = i*i;
-
-	/* buff stores the current column in step 2 */
-	buff = malloc(height * sizeof(int));
-	if (!buff)
-		goto error_exit;
+	INTEGERMA ima;
+	unsigned char *background;
+	int x, y;
 
-	/*-- Step 1 --*/
-	for (j = 0; j<height; j++)
-	{
-		ptstart = map + j*width;
-		ptend = ptstart + width;
-
-		/* forward scan */
-		df2 = sq + diag1;  /* the paper: df2 = sq + r, not large enough */
-		for (pt = ptstart; pt < ptend; pt++)
-			if (*pt)
-				*pt = *(++df2);
+	if (Nthreads < 1)
+		Nthreads = 1;
+	background = malloc((width + 2) * (height + 2));
+	if (!background)
+		return -1;
+	for (y = 0; y < height + 2; y++)
+		for (x = 0; x < width + 2; x++)
+			if (y == 0 || y == height + 1 || x == 0 || x == width + 1)
+				background[y*(width + 2) + x] = 1;
 			else
-				df2 = sq;
+				background[y*(width + 2) + x] = binary[(y - 1)*width + x - 1] ? 0 : 1;
+	ima.ft = featuretransform_packed(background, width + 2, height + 2, Nthreads);
+	free(background);
+	if (!ima.ft)
+		return -1;
+
+	ima.binary = binary;
+	ima.width = width;
+	ima.height = height;
+	ima.minsep2 = minsep2;
+	ima.skel = skel;
+	ima.dist = dist;
+	ima.bandheight = (height + 2 * Nthreads - 1) / (2 * Nthreads);
+	if (ima.bandheight < 1)
+		ima.bandheight = 1;
+	parallel_for((height + ima.bandheight - 1) / ima.bandheight, Nthreads, integermedialaxis_band, &ima);
+
+	free(ima.ft);
+	return 0;
+}
 
-		/* backward scan */
-		df2 = sq + diag1;  /* the paper: df2 = sq + r, not large enough */
-		for (--pt; pt != ptstart - 1; --pt)
-			if (*pt)
+/*
+  integer medial axis, a band of rows.
+  Notes: the pairs are compared from both ends, so a pixel only ever
+         writes its own output.
+*/
+static void integermedialaxis_band(void *ptr, int band)
+{
+	INTEGERMA *ima = ptr;
+	int fwidth = ima->width + 2;
+	unsigned int *ft = ima->ft;
+	unsigned int fp;
+	int y0, y1;
+	int x, y;
+	int X, Y;
+	int onaxis;
+	int dx, dy;
+
+	y0 = band * ima->bandheight;
+	y1 = y0 + ima->bandheight < ima->height ? y0 + ima->bandheight : ima->height;
+	for (y = y0; y < y1; y++)
+		for (x = 0; x < ima->width; x++)
+		{
+			/* co-ordinates in the bordered feature transform */
+			X = x + 1;
+			Y = y + 1;
+			fp = ft[Y*fwidth + X];
+			onaxis = 0;
+			if (ima->binary[y*ima->width + x])
 			{
-			if (*pt > *(++df2))
-				*pt = *df2;
+				if ((integermedialaxis_pair(fp, ft[Y*fwidth + X + 1], X, Y, X + 1, Y, ima->minsep2) & 1) ||
+					(integermedialaxis_pair(fp, ft[(Y + 1)*fwidth + X], X, Y, X, Y + 1, ima->minsep2) & 1) ||
+					(integermedialaxis_pair(ft[Y*fwidth + X - 1], fp, X - 1, Y, X, Y, ima->minsep2) & 2) ||
+					(integermedialaxis_pair(ft[(Y - 1)*fwidth + X], fp, X, Y - 1, X, Y, ima->minsep2) & 2))
+					onaxis = 1;
 			}
-			else
-				df2 = sq;
-	}
-
-
-	/*-- Step 2 --*/
-
-	for (i = 0; i<width; i++)
-	{
-		pt = map + i;
-
-		for (j = 0; j<height; j++, pt += width)
-			buff[j] = *pt;
-
-		pt = map + i + width;
-		a = 0;
-		buffer = buff[0];
-		for (j = 1; j < height; j++, pt += width)
-		{
-			if (a != 0)
-				--a;
-			if (buff[j] > buffer + 1)
+			if (ima->skel)
+				ima->skel[y*ima->width + x] = onaxis;
+			if (ima->dist)
 			{
-				b = (buff[j] - buffer - 1) / 2;
-				if (j + b + 1 > height)
-					b = height - 1 - j;
-
-				npt = pt + a*width;
-				for (l = a; l <= b; l++)
-				{
-					m = buffer + sq[l + 1];
-					if (buff[j + l] <= m)
-						break;   /* go to next column j */
-					if (m < *npt)
-						*npt = m;
-					npt += width;
-				}
-				a = b;
+				dx = FT_X(fp) - X;
+				dy = FT_Y(fp) - Y;
+				ima->dist[y*ima->width + x] = onaxis ? (float) sqrt((double) (dx*dx + dy*dy)) : 0.0f;
 			}
-			else
-				a = 0;
-			buffer = buff[j];
 		}
+}
 
+/*
+  Compare a pair of neighbouring pixels for the integer medial axis.
+  Params: fp, fq - the nearest background pixels, packed
+          px, py - the first pixel
+          qx, qy - the second pixel, right of or below the first
+          minsep2 - squared separation needed
+  Returns: 1 if the first pixel goes on the axis, 2 if the second does,
+           3 if both, 0 if neither.
+  Notes: the criterion is the sign of (fp - fq).(fp + fq - p - q),
+         positive when p is nearer the bisector of fp and fq.
+*/
+static int integermedialaxis_pair(unsigned int fp, unsigned int fq, int px, int py, int qx, int qy, int minsep2)
+{
+	int fpx = FT_X(fp), fpy = FT_Y(fp);
+	int fqx = FT_X(fq), fqy = FT_Y(fq);
+	long crit;
 
-		a = 0;
-		pt -= 2 * width;
-		buffer = buff[height - 1];
-
-		for (j = height - 2; j != -1; j--, pt -= width)
-		{
-			if (a != 0)
-				--a;
-			if (buff[j] > buffer + 1)
-			{
-				b = (buff[j] - buffer - 1) / 2;
-				if (j < b)
-					b = j;
+	if ((fpx - fqx)*(fpx - fqx) + (fpy - fqy)*(fpy - fqy) <= minsep2)
+		return 0;
+	crit = (long) (fpx - fqx) * (fpx + fqx - px - qx) + (long) (fpy - fqy) * (fpy + fqy - py - qy);
 
-				npt = pt - a*width;
-				for (l = a; l <= b; ++l)
-				{
-					m = buffer + sq[l + 1];
-					if (buff[j - l] <= m)
-						break;   /* go to next column j */
-					if (m < *npt)
-						*npt = m;
-					npt -= width;
-				}
-				a = b;
-			}
-			else
-				a = 0;
-			buffer = buff[j];
-		}
-
-	}
+	return (crit >= 0 ? 1 : 0) | (crit <= 0 ? 2 : 0);
+}
 
-	free(sq);
-	free(buff);
+/*
+  squared Euclidean distance transform of an image which already has
+  a clear border.
+*/
+static int *bordereddt(unsigned char *bordered, int width, int height)
+{
+	DTOPTIONS opt;
 
-	return map;
+	opt.metric = DT_EUCLIDEAN;
+	opt.output = DT_INT;
+	opt.border = DT_BORDER_IGNORE;
+	opt.Nthreads = 1;
 
-error_exit:
-	free(buff);
-	free(sq);
-	free(map);
-	return 0;
+	return distancetransform(bordered, width, height, &opt);
 }
 
-
 /*
 * C code from the article
 * "Efficient Binary Image Thinning using Neighborhood Maps"
@@ -474,84 +474,167 @@ static	unsigned char	delete[512] = {
   @param[in,out] binary - the bianry image
   @param xsize - image width
   @param ysize - image height
+  @returns 0 on success, -1 on out of memory, with the image untouched.
   @note Thinning is a different operation to medial axis
     transform, but similarly skeletonises the binary image.
 
+  Only a pixel with a clear 4-neighbour can be deleted, and it can
+  only become deletable when something in its 3x3 neighbourhood is
+  deleted. So we keep a list of candidates, starting with the border
+  pixels. After each sub-iteration the neighbours of deleted pixels
+  go on the list, and a pixel which has been looked at in all four
+  directions without a change round it comes off. Each pass costs
+  time proportional to the frontier, not the image.
 */
-void	thin(unsigned char *image, int xsize, int ysize)
+int	thin(unsigned char *image, int xsize, int ysize)
 {
 	int		x, y;		/* Pixel location		*/
-	int		i;		/* Pass index			*/
+	int		i, j;		/* Pass index, list index	*/
 	int		pc = 0;	/* Pass count			*/
 	int		count = 1;	/* Deleted pixel count		*/
-	int		p, q;		/* Neighborhood maps of adjacent*/
-	/* cells			*/
-	unsigned char		*qb;		/* Neighborhood maps of previous*/
-	/* scanline			*/
+	int		p;		/* Neighborhood map		*/
 	int		m;		/* Deletion direction mask	*/
+	int		*list = 0;	/* Candidate pixels		*/
+	int		Nlist = 0;	/* Number of candidates		*/
+	int		Nexamined;	/* Candidates looked at this time	*/
+	unsigned char	*state = 0;	/* Candidate state, see below	*/
+	int		pix, target;
+	int		tx, ty;
 	int width = xsize;
 
-	qb = malloc(xsize);
-	qb[xsize - 1] = 0;		/* Used for lower-right pixel	*/
+	/* state is 0 if not on the list, else the number of times
+	   looked at since the last change round it plus one, with
+	   THIN_DELETE set if it is to go this sub-iteration */
+#define THIN_DELETE 0x80
+
+	list = malloc((size_t) xsize * ysize * sizeof(int) + 1);
+	state = calloc((size_t) xsize * ysize + 1, 1);
+	if (!list || !state)
+	{
+		free(list);
+		free(state);
+		return -1;
+	}
 
-	while (count) {		/* Scan image while deletions	*/
+	for (y = 0; y < ysize; y++)
+		for (x = 0; x < xsize; x++)
+		{
+			if (!image[y*width + x])
+				continue;
+			if (y == 0 || !image[(y - 1)*width + x] ||
+				y == ysize - 1 || !image[(y + 1)*width + x] ||
+				x == 0 || !image[y*width + x - 1] ||
+				x == xsize - 1 || !image[y*width + x + 1])
+			{
+				list[Nlist++] = y*width + x;
+				state[y*width + x] = 1;
+			}
+		}
+
+	while (count && Nlist) {		/* Scan image while deletions	*/
 		pc++;
 		count = 0;
 
-		for (i = 0; i < 4; i++)
+		for (i = 0; i < 4 && Nlist; i++)
 		{
-
 			m = masks[i];
 
-			/* Build initial previous scan buffer.			*/
-
-			p = image[0] != 0;
-			for (x = 0; x < xsize - 1; x++)
-				qb[x] = p = ((p << 1) & 0006) | (image[x + 1] != 0);
-
-			/* Scan image for pixel deletion candidates.		*/
-
-			for (y = 0; y < ysize - 1; y++) {
-
-				q = qb[0];
-				p = ((q << 3) & 0110) | (image[(y + 1)*width] != 0);
-
-				for (x = 0; x < xsize - 1; x++) {
-					q = qb[x];
-					p = ((p << 1) & 0666) | ((q << 3) & 0110) |
-						(image[(y + 1)*width + x + 1] != 0);
-					qb[x] = p;
-					if (((p&m) == 0) && delete[p]) {
-						count++;
-						image[y*width + x] = 0;
-					}
-				}
-
-				/* Process right edge pixel.			*/
-
-				p = (p << 1) & 0666;
-				if ((p&m) == 0 && delete[p]) {
+			/* Decide on the neighbourhoods before the sub-iteration. */
+			for (j = 0; j < Nlist; j++)
+			{
+				pix = list[j];
+				p = neighbourmap(image, xsize, ysize, pix % width, pix / width);
+				state[pix]++;
+				if ((p&m) == 0 && delete[p])
+					state[pix] |= THIN_DELETE;
+			}
+			for (j = 0; j < Nlist; j++)
+				if (state[list[j]] & THIN_DELETE)
+				{
+					image[list[j]] = 0;
 					count++;
-					image[y*width + xsize - 1] = 0;
 				}
-			}
 
-			/* Process bottom scan line.				*/
+			/* Neighbours of deleted pixels go on, or start again. */
+			Nexamined = Nlist;
+			for (j = 0; j < Nexamined; j++)
+			{
+				pix = list[j];
+				if (!(state[pix] & THIN_DELETE))
+					continue;
+				for (ty = pix / width - 1; ty <= pix / width + 1; ty++)
+					for (tx = pix % width - 1; tx <= pix % width + 1; tx++)
+					{
+						if (tx < 0 || tx >= xsize || ty < 0 || ty >= ysize)
+							continue;
+						target = ty*width + tx;
+						if (!image[target])
+							continue;
+						if (state[target] == 0)
+							list[Nlist++] = target;
+						state[target] = 1;
+					}
+			}
 
-			for (x = 0; x < xsize; x++) {
-				q = qb[x];
-				p = ((p << 1) & 0666) | ((q << 3) & 0110);
-				if ((p&m) == 0 && delete[p]) {
-					count++;
-					image[(ysize - 1)*width + x] = 0;
-				}
+			/* Drop the deleted and the settled. */
+			for (j = 0, Nexamined = 0; j < Nlist; j++)
+			{
+				pix = list[j];
+				if ((state[pix] & THIN_DELETE) || state[pix] > 4)
+					state[pix] = 0;
+				else
+					list[Nexamined++] = pix;
 			}
+			Nlist = Nexamined;
 		}
 		if (pc > xsize && pc > ysize)
 			break;
 	}
 
-	free(qb);
+	free(list);
+	free(state);
+#undef THIN_DELETE
+	return 0;
+}
+
+/*
+  Neighbourhood map of a pixel, bits abcdefghi as for delete[],
+  with pixels off the image clear.
+*/
+static int neighbourmap(unsigned char *image, int width, int height, int x, int y)
+{
+	unsigned char *row = image + y*width;
+	unsigned char *c = row + x;
+	int p;
+
+	if (x > 0 && y > 0 && x < width - 1 && y < height - 1)
+		return ((c[-width - 1] != 0) << 8) | ((c[-width] != 0) << 7) | ((c[-width + 1] != 0) << 6) |
+			((c[-1] != 0) << 5) | ((c[0] != 0) << 4) | ((c[1] != 0) << 3) |
+			((c[width - 1] != 0) << 2) | ((c[width] != 0) << 1) | (c[width + 1] != 0);
+
+	p = (row[x] != 0) << 4;
+	if (x > 0)
+		p |= (row[x - 1] != 0) << 5;
+	if (x < width - 1)
+		p |= (row[x + 1] != 0) << 3;
+	if (y > 0)
+	{
+		p |= (row[x - width] != 0) << 7;
+		if (x > 0)
+			p |= (row[x - width - 1] != 0) << 8;
+		if (x < width - 1)
+			p |= (row[x - width + 1] != 0) << 6;
+	}
+	if (y < height - 1)
+	{
+		p |= (row[x + width] != 0) << 1;
+		if (x > 0)
+			p |= (row[x + width - 1] != 0) << 2;
+		if (x < width - 1)
+			p |= row[x + width + 1] != 0;
+	}
+
+	return p;
 }
 
 /*
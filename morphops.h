@@ -0,0 +1,34 @@
+#ifndef morphops_h
+#define morphops_h
+
+/*
+  A structuring element stored as horizontal runs of set cells.
+*/
+typedef struct
+{
+  int dy;     /**< row offset from the origin */
+  int left;   /**< column offset of first cell in run */
+  int right;  /**< column offset of last cell in run */
+} SERUN;
+
+typedef struct
+{
+  int swidth;  /**< structuring element width */
+  int sheight; /**< structuring element height */
+  int Nruns;   /**< number of runs */
+  SERUN *runs; /**< the runs */
+} SERUNS;
+
+unsigned char *sediamond(int radius, int *swidth, int *sheight);
+unsigned char *sedisk(int radius, int *swidth, int *sheight);
+unsigned char *seline(double length, double width, double theta, int *swidth, int *sheight);
+unsigned char *seoctagon(int radius, int *swidth, int *sheight);
+unsigned char *serectangle(int width, int height, int *swidth, int *sheight);
+unsigned char *sesquare(int width, int *swidth, int *sheight);
+
+SERUNS *compilese(unsigned char *sel, int swidth, int sheight);
+void killseruns(SERUNS *se);
+int dilate_runs(unsigned char *binary, int width, int height, SERUNS *se);
+int erode_runs(unsigned char *binary, int width, int height, SERUNS *se);
+
+#endif
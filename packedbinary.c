@@ -0,0 +1,649 @@
+/**@file
+   Packed binary images.
+
+   The rest of the library uses one byte per pixel. For very large
+   images that is eight times more memory than we need, and every
+   operation moves eight times as much data as it should. Here we
+   store the image one bit per pixel, rows padded out to a whole
+   number of 64-bit words, and the core operations work on a word,
+   that is 64 pixels, at a time.
+
+   packbinary() and unpackbinary() convert to and from the usual
+   byte-per-pixel layout.
+
+   By Malcolm McLean.
+*/
+#include <stdlib.h>
+#include <string.h>
+
+#include "packedbinary.h"
+
+static PACKEDWORD rowword(PACKEDWORD *row, int Nwords, int bitpos);
+static PACKEDWORD tailmask(int width);
+static int popcount64(PACKEDWORD x);
+static int lowestbit(PACKEDWORD x);
+static int highestbit(PACKEDWORD x);
+
+/**
+  Create an empty packed binary image.
+
+  @param width - image width
+  @param height - image height
+  @returns The image with all pixels clear, 0 on out of memory.
+*/
+PACKEDBINARY *packedbinary(int width, int height)
+{
+  PACKEDBINARY *answer;
+
+  answer = malloc(sizeof(PACKEDBINARY));
+  if(!answer)
+    return 0;
+  answer->width = width;
+  answer->height = height;
+  answer->stride = (width + 63) / 64;
+  answer->bits = calloc((size_t) answer->stride * height + 1, sizeof(PACKEDWORD));
+  if(!answer->bits)
+  {
+    free(answer);
+    return 0;
+  }
+
+  return answer;
+}
+
+/**
+  Packed binary image destructor.
+
+  @param pb - the image to destroy.
+*/
+void killpackedbinary(PACKEDBINARY *pb)
+{
+  if(pb)
+  {
+    free(pb->bits);
+    free(pb);
+  }
+}
+
+/**
+  Pack a byte-per-pixel binary image.
+
+  @param[in] binary - the binary image
+  @param width - image width
+  @param height - image height
+  @returns The packed image, 0 on out of memory.
+*/
+PACKEDBINARY *packbinary(unsigned char *binary, int width, int height)
+{
+  PACKEDBINARY *answer;
+  PACKEDWORD *row;
+  PACKEDWORD word;
+  int x, y;
+  int i;
+
+  answer = packedbinary(width, height);
+  if(!answer)
+    return 0;
+
+  for(y=0;y<height;y++)
+  {
+    row = answer->bits + (size_t) y * answer->stride;
+    for(x=0;x<width;x+=64)
+    {
+      word = 0;
+      for(i=0;i<64 && x+i<width;i++)
+        if(binary[y*width+x+i])
+          word |= ((PACKEDWORD) 1) << i;
+      row[x/64] = word;
+    }
+  }
+
+  return answer;
+}
+
+/**
+  Unpack a packed binary image to one byte per pixel.
+
+  @param[in] pb - the packed image
+  @returns Malloced byte-per-pixel image, 0 on out of memory.
+*/
+unsigned char *unpackbinary(PACKEDBINARY *pb)
+{
+  unsigned char *answer;
+  PACKEDWORD *row;
+  PACKEDWORD word;
+  int x, y;
+  int i;
+
+  answer = malloc((size_t) pb->width * pb->height);
+  if(!answer)
+    return 0;
+
+  for(y=0;y<pb->height;y++)
+  {
+    row = pb->bits + (size_t) y * pb->stride;
+    for(x=0;x<pb->width;x+=64)
+    {
+      word = row[x/64];
+      for(i=0;i<64 && x+i<pb->width;i++)
+        answer[y*pb->width+x+i] = (unsigned char) ((word >> i) & 1);
+    }
+  }
+
+  return answer;
+}
+
+/**
+  Dilate operation on a packed image.
+
+  @param[in,out] pb - the packed image
+  @param[in] sel - the selection element (one byte per cell)
+  @param swidth - selection element width
+  @param sheight - selection element height
+  @returns 0 on success, -1 on error.
+  @note Gives the same result as dilate(). Each set cell of the
+    selection element costs one shift and OR per 64 pixels.
+*/
+int packed_dilate(PACKEDBINARY *pb, unsigned char *sel, int swidth, int sheight)
+{
+  PACKEDWORD *answer;
+  PACKEDWORD *src, *dest;
+  int stride = pb->stride;
+  int x, y, sx, sy;
+  int dx, dy;
+  int i;
+
+  answer = calloc((size_t) stride * pb->height + 1, sizeof(PACKEDWORD));
+  if(!answer)
+    return -1;
+
+  for(sy=0;sy<sheight;sy++)
+    for(sx=0;sx<swidth;sx++)
+    {
+      if(sel[sy*swidth+sx] != 1)
+        continue;
+      dx = sx - swidth/2;
+      dy = sy - sheight/2;
+      for(y=0;y<pb->height;y++)
+      {
+        if(y + dy < 0 || y + dy >= pb->height)
+          continue;
+        src = pb->bits + (size_t) (y + dy) * stride;
+        dest = answer + (size_t) y * stride;
+        if(dx == 0)
+        {
+          for(x=0;x<stride;x++)
+            dest[x] |= src[x];
+        }
+        else
+        {
+          for(x=0;x<stride;x++)
+            dest[x] |= rowword(src, stride, x*64 + dx);
+        }
+      }
+    }
+
+  if(stride > 0)
+    for(y=0;y<pb->height;y++)
+      answer[(size_t) y * stride + stride - 1] &= tailmask(pb->width);
+
+  for(i=0;i<stride*pb->height;i++)
+    pb->bits[i] = answer[i];
+  free(answer);
+
+  return 0;
+}
+
+/**
+  Erode operation on a packed image.
+
+  @param[in,out] pb - the packed image
+  @param[in] sel - the selection element (one byte per cell)
+  @param swidth - selection element width
+  @param sheight - selection element height
+  @returns 0 on success, -1 on error.
+  @note Gives the same result as erode(), pixels off the image count as clear.
+*/
+int packed_erode(PACKEDBINARY *pb, unsigned char *sel, int swidth, int sheight)
+{
+  PACKEDWORD *answer;
+  PACKEDWORD *src, *dest;
+  int stride = pb->stride;
+  int x, y, sx, sy;
+  int dx, dy;
+  int i;
+
+  answer = malloc(((size_t) stride * pb->height + 1) * sizeof(PACKEDWORD));
+  if(!answer)
+    return -1;
+  for(i=0;i<stride*pb->height;i++)
+    answer[i] = ~((PACKEDWORD) 0);
+
+  for(sy=0;sy<sheight;sy++)
+    for(sx=0;sx<swidth;sx++)
+    {
+      if(sel[sy*swidth+sx] != 1)
+        continue;
+      dx = sx - swidth/2;
+      dy = sy - sheight/2;
+      for(y=0;y<pb->height;y++)
+      {
+        dest = answer + (size_t) y * stride;
+        if(y + dy < 0 || y + dy >= pb->height)
+        {
+          for(x=0;x<stride;x++)
+            dest[x] = 0;
+          continue;
+        }
+        src = pb->bits + (size_t) (y + dy) * stride;
+        if(dx == 0)
+        {
+          for(x=0;x<stride;x++)
+            dest[x] &= src[x];
+        }
+        else
+        {
+          for(x=0;x<stride;x++)
+            dest[x] &= rowword(src, stride, x*64 + dx);
+        }
+      }
+    }
+
+  if(stride > 0)
+    for(y=0;y<pb->height;y++)
+      answer[(size_t) y * stride + stride - 1] &= tailmask(pb->width);
+
+  for(i=0;i<stride*pb->height;i++)
+    pb->bits[i] = answer[i];
+  free(answer);
+
+  return 0;
+}
+
+/**
+  Invert a packed image.
+
+  @param[in,out] pb - the packed image
+  \note in place.
+*/
+void packed_invertbinary(PACKEDBINARY *pb)
+{
+  int x, y;
+  PACKEDWORD *row;
+
+  for(y=0;y<pb->height;y++)
+  {
+    row = pb->bits + (size_t) y * pb->stride;
+    for(x=0;x<pb->stride;x++)
+      row[x] = ~row[x];
+    if(pb->stride > 0)
+      row[pb->stride-1] &= tailmask(pb->width);
+  }
+}
+
+/**
+  Get the area (number of set pixels) in a packed image.
+
+  @param[in] pb - the packed image
+  @returns number of set pixels.
+*/
+int packed_simplearea(PACKEDBINARY *pb)
+{
+  int i;
+  int answer = 0;
+
+  for(i=0;i<pb->stride*pb->height;i++)
+    answer += popcount64(pb->bits[i]);
+
+  return answer;
+}
+
+/**
+  Calculate the Euler number for a packed image.
+
+  @param[in] pb - the packed image
+  @returns Euler number, = number of objects - number of holes.
+  @note Gives the same result as eulernumber(). The bit-quad patterns
+    of 64 2x2 windows are found with bitwise operations on the pair of
+    rows, and counted with popcount.
+*/
+int packed_eulernumber(PACKEDBINARY *pb)
+{
+  PACKEDWORD *up, *down;
+  PACKEDWORD a, b, c, d;
+  PACKEDWORD odd, two, diagonal;
+  int answer = 0;
+  int x, y;
+
+  for(y=0;y<=pb->height;y++)
+  {
+    up = y > 0 ? pb->bits + (size_t) (y-1) * pb->stride : 0;
+    down = y < pb->height ? pb->bits + (size_t) y * pb->stride : 0;
+    if(pb->stride > 0)
+    {
+      /* the window hanging off the left edge */
+      a = up ? up[0] & 1 : 0;
+      c = down ? down[0] & 1 : 0;
+      answer += (int) (a ^ c);
+    }
+    for(x=0;x<pb->stride;x++)
+    {
+      /* a, c are the left columns of the windows, b, d the right */
+      a = up ? up[x] : 0;
+      c = down ? down[x] : 0;
+      b = a >> 1;
+      d = c >> 1;
+      if(x + 1 < pb->stride)
+      {
+        b |= up ? up[x+1] << 63 : 0;
+        d |= down ? down[x+1] << 63 : 0;
+      }
+      odd = a ^ b ^ c ^ d;
+      two = (a & b) | (c & d) | ((a ^ b) & (c ^ d));
+      diagonal = (a & d & ~b & ~c) | (b & c & ~a & ~d);
+      answer += popcount64(odd & ~two) - popcount64(odd & two) - 2 * popcount64(diagonal);
+    }
+  }
+
+  return answer / 4;
+}
+
+/**
+  Thin a packed image.
+
+  @param[in,out] pb - the packed image
+  @returns 0 on success, -1 on out of memory.
+  @note Same result as thin(), Rosenfeld's parallel thinning with
+    pixels off the image clear. Instead of looking up the deletion
+    table a pixel at a time, we test its conditions on 64 pixels at
+    once: a clear 4-neighbour in the direction of the sub-iteration,
+    at least two set 8-neighbours, and exactly one 8-connected run of
+    set neighbours (Yokoi's connectivity number is one).
+*/
+int packed_thin(PACKEDBINARY *pb)
+{
+  PACKEDWORD *saved;
+  PACKEDWORD *prev, *here, *down, *temp;
+  PACKEDWORD *row;
+  PACKEDWORD a, b, c, d, e, f, g, h, i;
+  PACKEDWORD ones, twos;
+  PACKEDWORD t0, t1, t2, t3, any, two;
+  PACKEDWORD clear, del;
+  int stride = pb->stride;
+  int count = 1;
+  int pc = 0;
+  int sub;
+  int x, y;
+
+  saved = malloc(2 * (size_t) stride * sizeof(PACKEDWORD) + 1);
+  if(!saved)
+    return -1;
+
+  while(count)
+  {
+    pc++;
+    count = 0;
+    for(sub=0;sub<4;sub++)
+    {
+      /* rows above are already thinned, so keep the originals */
+      prev = 0;
+      here = saved;
+      temp = saved + stride;
+      for(y=0;y<pb->height;y++)
+      {
+        row = pb->bits + (size_t) y * stride;
+        memcpy(here, row, stride * sizeof(PACKEDWORD));
+        down = y < pb->height - 1 ? row + stride : 0;
+        for(x=0;x<stride;x++)
+        {
+          e = here[x];
+          if(!e)
+            continue;
+          b = prev ? prev[x] : 0;
+          a = prev ? (b << 1) | (x > 0 ? prev[x-1] >> 63 : 0) : 0;
+          c = prev ? (b >> 1) | (x + 1 < stride ? prev[x+1] << 63 : 0) : 0;
+          d = (e << 1) | (x > 0 ? here[x-1] >> 63 : 0);
+          f = (e >> 1) | (x + 1 < stride ? here[x+1] << 63 : 0);
+          h = down ? down[x] : 0;
+          g = down ? (h << 1) | (x > 0 ? down[x-1] >> 63 : 0) : 0;
+          i = down ? (h >> 1) | (x + 1 < stride ? down[x+1] << 63 : 0) : 0;
+
+          /* sub-iterations delete from the N, S, W and E */
+          switch(sub)
+          {
+            case 0: clear = ~b; break;
+            case 1: clear = ~h; break;
+            case 2: clear = ~d; break;
+            default: clear = ~f; break;
+          }
+
+          ones = a;
+          twos = ones & b;
+          ones |= b;
+          twos |= ones & c;
+          ones |= c;
+          twos |= ones & d;
+          ones |= d;
+          twos |= ones & f;
+          ones |= f;
+          twos |= ones & g;
+          ones |= g;
+          twos |= ones & h;
+          ones |= h;
+          twos |= ones & i;
+
+          t0 = ~f & (c | b);
+          t1 = ~b & (a | d);
+          t2 = ~d & (g | h);
+          t3 = ~h & (i | f);
+          any = t0 | t1 | t2 | t3;
+          two = (t0 & t1) | (t2 & t3) | ((t0 | t1) & (t2 | t3));
+
+          del = e & clear & twos & any & ~two;
+          if(del)
+          {
+            row[x] &= ~del;
+            count += popcount64(del);
+          }
+        }
+        prev = here;
+        here = temp;
+        temp = prev;
+      }
+    }
+    if(pc > pb->width && pc > pb->height)
+      break;
+  }
+
+  free(saved);
+  return 0;
+}
+
+/**
+  Get the bounding box of the set pixels in a packed image.
+
+  @param[in] pb - the packed image
+  @param[out] x return for bounding box top left x co-ordinate
+  @param[out] y return for bounding box top left y co-ordinate
+  @param[out] bbwidth - return for bounding box width
+  @param[out] bbheight - return for bounding box height
+  @note x and y are -1 if there are no set pixels in the image.
+*/
+void packed_boundingbox(PACKEDBINARY *pb, int *x, int *y, int *bbwidth, int *bbheight)
+{
+  int top, bottom, left, right;
+  int i, iy;
+  PACKEDWORD *row;
+  PACKEDWORD word;
+
+  for(top=0;top<pb->height;top++)
+  {
+    row = pb->bits + (size_t) top * pb->stride;
+    for(i=0;i<pb->stride;i++)
+      if(row[i])
+        break;
+    if(i < pb->stride)
+      break;
+  }
+  if(top == pb->height)
+  {
+    *x = -1;
+    *y = -1;
+    *bbwidth = 0;
+    *bbheight = 0;
+    return;
+  }
+  for(bottom=pb->height-1;bottom>top;bottom--)
+  {
+    row = pb->bits + (size_t) bottom * pb->stride;
+    for(i=0;i<pb->stride;i++)
+      if(row[i])
+        break;
+    if(i < pb->stride)
+      break;
+  }
+
+  /* OR the columns of the rows together word by word */
+  left = -1;
+  right = -1;
+  for(i=0;i<pb->stride;i++)
+  {
+    word = 0;
+    for(iy=top;iy<=bottom;iy++)
+      word |= pb->bits[(size_t) iy * pb->stride + i];
+    if(word)
+    {
+      if(left == -1)
+        left = i * 64 + lowestbit(word);
+      right = i * 64 + highestbit(word);
+    }
+  }
+
+  *x = left;
+  *y = top;
+  *bbwidth = right - left + 1;
+  *bbheight = bottom - top + 1;
+}
+
+/**
+  Copy a packed image.
+
+  @param[in] pb - the packed image
+  @returns The copy, 0 on out of memory.
+*/
+PACKEDBINARY *packed_copybinary(PACKEDBINARY *pb)
+{
+  PACKEDBINARY *answer;
+
+  answer = packedbinary(pb->width, pb->height);
+  if(!answer)
+    return 0;
+  memcpy(answer->bits, pb->bits, (size_t) pb->stride * pb->height * sizeof(PACKEDWORD));
+
+  return answer;
+}
+
+/**
+  Take a sub-image of a packed image.
+
+  @param[in] pb - the packed image
+  @param x - top left x co-ordinate of sub-image
+  @param y - top left y co-ordinate of sub-image
+  @param swidth - sub image width
+  @param sheight - sub image height
+  @returns The sub image, 0 on out of memory.
+  @note If the sub-image extends the image boundary, it is zero padded, so x and y can be negative.
+*/
+PACKEDBINARY *packed_subbinary(PACKEDBINARY *pb, int x, int y, int swidth, int sheight)
+{
+  PACKEDBINARY *answer;
+  PACKEDWORD *src, *dest;
+  int ix, iy;
+
+  answer = packedbinary(swidth, sheight);
+  if(!answer)
+    return 0;
+
+  for(iy=0;iy<sheight;iy++)
+  {
+    if(y + iy < 0 || y + iy >= pb->height)
+      continue;
+    src = pb->bits + (size_t) (y + iy) * pb->stride;
+    dest = answer->bits + (size_t) iy * answer->stride;
+    for(ix=0;ix<answer->stride;ix++)
+      dest[ix] = rowword(src, pb->stride, x + ix * 64);
+    if(answer->stride > 0)
+      dest[answer->stride-1] &= tailmask(swidth);
+  }
+
+  return answer;
+}
+
+/*
+  Get 64 pixels of a packed row.
+  Params: row - the row
+          Nwords - number of words in the row
+          bitpos - index of first pixel wanted, may be negative
+  Returns: the pixels bitpos to bitpos + 63, zero where off the row.
+*/
+static PACKEDWORD rowword(PACKEDWORD *row, int Nwords, int bitpos)
+{
+  int wi, sh;
+  PACKEDWORD lo, hi;
+
+  if(bitpos >= 0)
+    wi = bitpos / 64;
+  else
+    wi = -((63 - bitpos) / 64);
+  sh = bitpos - wi * 64;
+
+  lo = (wi >= 0 && wi < Nwords) ? row[wi] : 0;
+  if(sh == 0)
+    return lo;
+  hi = (wi + 1 >= 0 && wi + 1 < Nwords) ? row[wi+1] : 0;
+
+  return (lo >> sh) | (hi << (64 - sh));
+}
+
+/*
+  mask for the valid bits of the last word of a row.
+*/
+static PACKEDWORD tailmask(int width)
+{
+  if(width % 64 == 0)
+    return ~((PACKEDWORD) 0);
+  return (((PACKEDWORD) 1) << (width % 64)) - 1;
+}
+
+/*
+  count set bits in a word
+*/
+static int popcount64(PACKEDWORD x)
+{
+  PACKEDWORD bytes = ~((PACKEDWORD) 0) / 255; /* 0x0101010101010101 */
+
+  x = x - ((x >> 1) & (bytes * 0x55));
+  x = (x & (bytes * 0x33)) + ((x >> 2) & (bytes * 0x33));
+  x = (x + (x >> 4)) & (bytes * 0x0F);
+  return (int) ((x * bytes) >> 56);
+}
+
+/*
+  index of lowest set bit, word must be non-zero
+*/
+static int lowestbit(PACKEDWORD x)
+{
+  return popcount64((x & (~x + 1)) - 1);
+}
+
+/*
+  index of highest set bit, word must be non-zero
+*/
+static int highestbit(PACKEDWORD x)
+{
+  int answer = 0;
+
+  while(x >>= 1)
+    answer++;
+  return answer;
+}
@@ -0,0 +1,51 @@
+#ifndef packedbinary_h
+#define packedbinary_h
+
+#include <limits.h>
+
+/*
+  The word the pixels are packed into. It must be an unsigned 64 bit
+  type, which ANSI C doesn't promise, so it is chosen here, once.
+*/
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L
+#include <stdint.h>
+typedef uint64_t PACKEDWORD;
+#elif ULONG_MAX > 0xFFFFFFFFUL
+typedef unsigned long PACKEDWORD;
+#elif defined(_MSC_VER)
+typedef unsigned __int64 PACKEDWORD;
+#else
+#error "packedbinary needs an unsigned 64 bit integer type"
+#endif
+
+/*
+  Binary image packed one bit per pixel.
+  Pixel x of row y is bit (x % 64) of bits[y * stride + x / 64].
+  Bits past the image width in the last word of a row are always zero.
+*/
+typedef struct
+{
+  int width;      /**< image width in pixels */
+  int height;     /**< image height in pixels */
+  int stride;     /**< row stride in 64-bit words */
+  PACKEDWORD *bits; /**< the pixel data */
+} PACKEDBINARY;
+
+#define packed_getpixel(pb, x, y) \
+  ((int) (((pb)->bits[(y) * (pb)->stride + ((x) >> 6)] >> ((x) & 63)) & 1))
+
+PACKEDBINARY *packedbinary(int width, int height);
+void killpackedbinary(PACKEDBINARY *pb);
+PACKEDBINARY *packbinary(unsigned char *binary, int width, int height);
+unsigned char *unpackbinary(PACKEDBINARY *pb);
+int packed_dilate(PACKEDBINARY *pb, unsigned char *sel, int swidth, int sheight);
+int packed_erode(PACKEDBINARY *pb, unsigned char *sel, int swidth, int sheight);
+void packed_invertbinary(PACKEDBINARY *pb);
+int packed_simplearea(PACKEDBINARY *pb);
+int packed_eulernumber(PACKEDBINARY *pb);
+int packed_thin(PACKEDBINARY *pb);
+void packed_boundingbox(PACKEDBINARY *pb, int *x, int *y, int *bbwidth, int *bbheight);
+PACKEDBINARY *packed_copybinary(PACKEDBINARY *pb);
+PACKEDBINARY *packed_subbinary(PACKEDBINARY *pb, int x, int y, int swidth, int sheight);
+
+#endif
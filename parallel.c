@@ -0,0 +1,107 @@
+/**@file
+   Run independent jobs on several threads.
+
+   The library is ANSI C with no dependencies, so by default the jobs
+   simply run one after the other. Compile with BINARY_PTHREADS defined
+   (and link with -lpthread) to spread them over POSIX threads.
+
+   By Malcolm McLean.
+*/
+#include <stdlib.h>
+
+#include "parallel.h"
+
+#ifdef BINARY_PTHREADS
+#include <pthread.h>
+
+typedef struct
+{
+  pthread_mutex_t lock;
+  int next;
+  int Njobs;
+  void (*job)(void *ptr, int index);
+  void *ptr;
+} JOBQUEUE;
+
+static void *worker(void *arg);
+#endif
+
+/**
+  Run jobs 0 to Njobs - 1, in parallel where possible.
+
+  @param Njobs - number of jobs
+  @param Nthreads - maximum number of threads to use, including the caller
+  @param job - function to run, called as job(ptr, index)
+  @param ptr - context pointer passed to job
+  @note Returns when every job is done. Jobs may run in any order, and
+    on any thread, so they must not write to shared memory that another
+    job reads or writes. If threads can't be created, or the library
+    was built without BINARY_PTHREADS, the jobs run on the calling thread.
+*/
+void parallel_for(int Njobs, int Nthreads, void (*job)(void *ptr, int index), void *ptr)
+{
+#ifdef BINARY_PTHREADS
+  JOBQUEUE queue;
+  pthread_t *threads;
+  int Nstarted = 0;
+  int i;
+
+  if(Nthreads > Njobs)
+    Nthreads = Njobs;
+  if(Nthreads > 1)
+  {
+    threads = malloc((Nthreads - 1) * sizeof(pthread_t));
+    if(threads && pthread_mutex_init(&queue.lock, 0) == 0)
+    {
+      queue.next = 0;
+      queue.Njobs = Njobs;
+      queue.job = job;
+      queue.ptr = ptr;
+      for(i=0;i<Nthreads-1;i++)
+      {
+        if(pthread_create(&threads[i], 0, worker, &queue) != 0)
+          break;
+        Nstarted++;
+      }
+      worker(&queue);
+      for(i=0;i<Nstarted;i++)
+        pthread_join(threads[i], 0);
+      pthread_mutex_destroy(&queue.lock);
+      free(threads);
+      return;
+    }
+    free(threads);
+  }
+#else
+  (void) Nthreads;
+#endif
+  {
+    int index;
+
+    for(index=0;index<Njobs;index++)
+      (*job)(ptr, index);
+  }
+}
+
+#ifdef BINARY_PTHREADS
+/*
+  take jobs off the queue until there are none left
+*/
+static void *worker(void *arg)
+{
+  JOBQUEUE *queue = arg;
+  int index;
+
+  while(1)
+  {
+    pthread_mutex_lock(&queue->lock);
+    index = queue->next++;
+    pthread_mutex_unlock(&queue->lock);
+    if(index >= queue->Njobs)
+      break;
+    (*queue->job)(queue->ptr, index);
+  }
+
+  return 0;
+}
+#endif
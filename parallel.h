@@ -0,0 +1,6 @@
+#ifndef parallel_h
+#define parallel_h
+
+void parallel_for(int Njobs, int Nthreads, void (*job)(void *ptr, int index), void *ptr);
+
+#endif
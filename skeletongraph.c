@@ -0,0 +1,1036 @@
+/**@file
+   Skeleton graphs.
+
+   Turns a one pixel wide skeleton, from thin() or a medial axis, into
+   a graph. The nodes are the line ends and branch points, and the edges
+   are the chains of pixels between them.
+
+   We make one raster scan of the image. A pixel is classified from
+   its 3x3 neighbourhood when it is first looked at, by the scan or by
+   a trace running ahead of it. At each node pixel the touching branch
+   pixels are gathered into one node, and we walk out along its chains,
+   so each chain pixel is traced once. A chain stops at the first pixel
+   which touches another node. A chain pixel which would cut off a
+   chain if we went on or stopped there becomes a branch point itself.
+   Chains left over are closed loops, and only if there are any do we
+   scan again to give each one a node. Finally short spurs can be
+   pruned, and the branch points left with only two edges are dissolved
+   into a single edge, through the pixels of the branch point.
+
+   By Malcolm McLean.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "skeletongraph.h"
+
+/* work buffer tags, node pixels have their node index plus one */
+#define TAG_UNSEEN 0  /* clear, or set but not classified yet */
+#define TAG_CHAIN -1
+#define TAG_VISITED -2
+#define TAG_NODE -3   /* minus the pixel's own node type */
+
+#define NODE_DEAD -1
+#define EDGE_ALIVE -1
+#define EDGE_PRUNED -2
+
+/* what a trace does after a chain pixel */
+#define STEP_CHAIN 0     /* go on to the next chain pixel */
+#define STEP_NODE 1      /* stop, the pixel touches another node */
+#define STEP_JUNCTION 2  /* stop, the pixel is a branch point */
+#define STEP_END 3       /* stop, nowhere to go */
+#define STEP_ERROR -1    /* out of memory */
+
+typedef struct
+{
+  int node1;      /* node at the start */
+  int node2;      /* node at the end */
+  int attach1;    /* pixel of node1 the chain leaves from */
+  int attach2;    /* pixel of node2 the chain arrives at */
+  int start;      /* index of the first chain pixel in the buffer */
+  int N;          /* number of chain pixels */
+  double length;  /* node to node length */
+  double rsum;    /* sum of the radii of the chain pixels */
+  int mergedinto; /* edge this one was merged into, or EDGE_ALIVE or EDGE_PRUNED */
+} SGEDGE;
+
+typedef struct
+{
+  unsigned char *skel;    /* the skeleton */
+  int width;              /* image width */
+  int height;             /* image height */
+  int *tags;              /* pixel tags */
+  int Nchain;             /* chain pixels classified but not traced */
+  float *radius;          /* distance transform, or null */
+  SKELNODE *nodes;        /* the nodes */
+  int Nnodes;             /* number of nodes */
+  int nodecapacity;       /* space for nodes */
+  SGEDGE *edges;          /* the edges */
+  int Nedges;             /* number of edges */
+  int edgecapacity;       /* space for edges */
+  int *bx;                /* chain pixels x */
+  int *by;                /* chain pixels y */
+  int Nbuff;              /* number of chain pixels */
+  int buffcapacity;       /* space for chain pixels */
+  int *queue;             /* workspace for searches over node pixels */
+  int Nqueue;             /* number of entries in the queue */
+  int queuecapacity;      /* space for queue entries */
+  int *pending;           /* new branch pixels still to walk out from */
+  int Npending;           /* number of pending pixels */
+  int pendingcapacity;    /* space for pending pixels */
+} SGBUILD;
+
+/* neighbour offsets, 4-neighbours first so chains take the square step */
+static const int ndx[8] = {0, 1, 0, -1, 1, 1, -1, -1};
+static const int ndy[8] = {-1, 0, 1, 0, -1, 1, 1, -1};
+
+static int gettag(SGBUILD *sb, int x, int y);
+static int classify(unsigned char *skel, int width, int height, int x, int y);
+static int nodeat(SGBUILD *sb, int x, int y);
+static int gathernode(SGBUILD *sb, int x, int y);
+static int walkout(SGBUILD *sb, int x, int y);
+static int trace(SGBUILD *sb, int node, int px, int py, int cx, int cy);
+static int nextstep(SGBUILD *sb, int node, int cx, int cy, int *nx, int *ny, int *endnode);
+static int branchpoint(SGBUILD *sb, int node, int x, int y, int except);
+static int linkend(SGBUILD *sb, int node);
+static int prune(SGBUILD *sb, double minspur);
+static int mergeedges(SGBUILD *sb, int node, int e1, int e2);
+static int pushnodepath(SGBUILD *sb, int node, int from, int to, double *length, double *rsum);
+static int resolveedge(SGBUILD *sb, int e);
+static SKELETONGRAPH *buildgraph(SGBUILD *sb);
+static int addnode(SGBUILD *sb, int x, int y, int type);
+static int addedge(SGBUILD *sb, int node1, int node2, int attach1, int attach2,
+                   int start, int N, double length, double rsum);
+static int pushint(int **buff, int *N, int *capacity, int value);
+static int pushpixel(SGBUILD *sb, int x, int y);
+static int adjacent(int width, int pix1, int pix2);
+static double steplength(int x1, int y1, int x2, int y2);
+
+/**
+  Convert a skeleton to a graph.
+
+  @param[in] skel - the skeleton, one pixel wide
+  @param width - image width
+  @param height - image height
+  @param[in] radius - distance transform of the original shape (may be null)
+  @param minspur - edges from a line end to a branch point shorter than
+     this are pruned off, 0 to keep everything
+  @returns The graph, 0 on out of memory.
+  @note Nodes are line ends (one run of neighbours), branch points
+    (three or more runs, or four or more neighbours, with touching
+    branch pixels making one node), isolated pixels, and one pixel on
+    each closed loop without other nodes. A chain pixel where the
+    skeleton forks is a branch point too. An edge between two line
+    ends, that is a plain line segment, is never pruned.
+*/
+SKELETONGRAPH *skeletongraph(unsigned char *skel, int width, int height, float *radius, double minspur)
+{
+  SGBUILD sb;
+  SKELETONGRAPH *answer = 0;
+  int node;
+  int tag;
+  int pix;
+  int x, y, i;
+
+  memset(&sb, 0, sizeof(SGBUILD));
+  sb.skel = skel;
+  sb.width = width;
+  sb.height = height;
+  sb.radius = radius;
+  sb.tags = calloc((size_t) width * height + 1, sizeof(int));
+  if(!sb.tags)
+    goto out_of_memory;
+
+  for(y=0;y<height;y++)
+    for(x=0;x<width;x++)
+    {
+      tag = gettag(&sb, x, y);
+      if(tag <= 0 && tag > TAG_NODE)
+        continue;
+      if(nodeat(&sb, x, y) < 0 || walkout(&sb, x, y))
+        goto out_of_memory;
+      while(sb.Npending)
+      {
+        pix = sb.pending[--sb.Npending];
+        if(walkout(&sb, pix % width, pix / width))
+          goto out_of_memory;
+      }
+    }
+
+  /* anything left is a closed loop */
+  for(i=0;i<width*height && sb.Nchain > 0;i++)
+  {
+    if(sb.tags[i] != TAG_CHAIN)
+      continue;
+    node = addnode(&sb, i % width, i / width, SKEL_LOOP);
+    if(node < 0)
+      goto out_of_memory;
+    sb.tags[i] = node + 1;
+    sb.Nchain--;
+    if(walkout(&sb, i % width, i / width))
+      goto out_of_memory;
+    while(sb.Npending)
+    {
+      pix = sb.pending[--sb.Npending];
+      if(walkout(&sb, pix % width, pix / width))
+        goto out_of_memory;
+    }
+  }
+
+  if(minspur > 0 && prune(&sb, minspur))
+    goto out_of_memory;
+
+  answer = buildgraph(&sb);
+
+out_of_memory:
+  free(sb.tags);
+  free(sb.nodes);
+  free(sb.edges);
+  free(sb.bx);
+  free(sb.by);
+  free(sb.queue);
+  free(sb.pending);
+  return answer;
+}
+
+/**
+  Skeleton graph destructor.
+
+  @param sg - the graph
+*/
+void killskeletongraph(SKELETONGRAPH *sg)
+{
+  if(sg)
+  {
+    free(sg->nodes);
+    free(sg->edges);
+    free(sg->xbuff);
+    free(sg->ybuff);
+    free(sg);
+  }
+}
+
+/*
+  Get the tag of a pixel, classifying it if we haven't yet.
+  Returns: TAG_UNSEEN for a clear pixel or one off the image.
+*/
+static int gettag(SGBUILD *sb, int x, int y)
+{
+  int *tag;
+
+  if(x < 0 || x >= sb->width || y < 0 || y >= sb->height || !sb->skel[y*sb->width+x])
+    return TAG_UNSEEN;
+  tag = &sb->tags[y*sb->width+x];
+  if(*tag == TAG_UNSEEN)
+  {
+    *tag = classify(sb->skel, sb->width, sb->height, x, y);
+    if(*tag == TAG_CHAIN)
+      sb->Nchain++;
+  }
+  return *tag;
+}
+
+/*
+  Classify a set pixel.
+  Params: skel - the skeleton
+          width - image width
+          height - image height
+          x, y - the pixel
+  Returns: TAG_CHAIN for a pixel in the middle of a chain, else
+           TAG_NODE minus the node type.
+  Notes: two runs of neighbours is a chain, as long as there are no more
+         than three neighbours, which allows a square corner.
+*/
+static int classify(unsigned char *skel, int width, int height, int x, int y)
+{
+  /* round the pixel N, NE, E, SE, S, SW, W, NW */
+  static const int rx[8] = {0, 1, 1, 1, 0, -1, -1, -1};
+  static const int ry[8] = {-1, -1, 0, 1, 1, 1, 0, -1};
+  int ring[8];
+  int N = 0;
+  int runs = 0;
+  int tx, ty;
+  int i;
+
+  for(i=0;i<8;i++)
+  {
+    tx = x + rx[i];
+    ty = y + ry[i];
+    ring[i] = (tx >= 0 && tx < width && ty >= 0 && ty < height && skel[ty*width+tx]) ? 1 : 0;
+    N += ring[i];
+  }
+  for(i=0;i<8;i++)
+    if(ring[i] && !ring[(i+7)%8])
+      runs++;
+
+  if(N == 0)
+    return TAG_NODE - SKEL_ISOLATED;
+  if(runs == 1)
+    return TAG_NODE - SKEL_END;
+  if(runs == 2 && N <= 3)
+    return TAG_CHAIN;
+  return TAG_NODE - SKEL_BRANCH;
+}
+
+/*
+  The node a pixel belongs to, gathering it if need be.
+  Returns: the node index, -1 if the pixel isn't a node pixel,
+           -2 on out of memory.
+*/
+static int nodeat(SGBUILD *sb, int x, int y)
+{
+  int tag = gettag(sb, x, y);
+  int node;
+
+  if(tag > 0)
+    return tag - 1;
+  if(tag > TAG_NODE)
+    return -1;
+  node = gathernode(sb, x, y);
+  return node < 0 ? -2 : node;
+}
+
+/*
+  Gather a group of touching branch pixels into a node.
+  Line ends and isolated pixels are always nodes on their own.
+  Params: sb - the graph under construction
+          x, y - a pixel of the group
+  Returns: the node index, -1 on out of memory.
+  Notes: the node's position is its first pixel in raster order.
+*/
+static int gathernode(SGBUILD *sb, int x, int y)
+{
+  int width = sb->width;
+  int type;
+  int node;
+  int pix;
+  int tx, ty;
+  int i, j;
+
+  type = TAG_NODE - sb->tags[y*width+x];
+  node = addnode(sb, x, y, type);
+  if(node < 0)
+    return -1;
+  sb->tags[y*width+x] = node + 1;
+  if(type != SKEL_BRANCH)
+    return node;
+
+  sb->Nqueue = 0;
+  if(pushint(&sb->queue, &sb->Nqueue, &sb->queuecapacity, y*width+x))
+    return -1;
+  for(j=0;j<sb->Nqueue;j++)
+  {
+    pix = sb->queue[j];
+    for(i=0;i<8;i++)
+    {
+      tx = pix % width + ndx[i];
+      ty = pix / width + ndy[i];
+      if(gettag(sb, tx, ty) != TAG_NODE - SKEL_BRANCH)
+        continue;
+      sb->tags[ty*width+tx] = node + 1;
+      if(pushint(&sb->queue, &sb->Nqueue, &sb->queuecapacity, ty*width+tx))
+        return -1;
+      if(ty*width+tx < sb->nodes[node].y * width + sb->nodes[node].x)
+      {
+        sb->nodes[node].x = tx;
+        sb->nodes[node].y = ty;
+      }
+    }
+  }
+
+  return node;
+}
+
+/*
+  Trace the chains out from one node pixel, then join it to its
+  neighbour if it is a line end with nothing else.
+  Returns: 0 on success, -1 on out of memory.
+*/
+static int walkout(SGBUILD *sb, int x, int y)
+{
+  int node = sb->tags[y*sb->width+x] - 1;
+  int tx, ty;
+  int i;
+
+  for(i=0;i<8;i++)
+  {
+    tx = x + ndx[i];
+    ty = y + ndy[i];
+    if(gettag(sb, tx, ty) == TAG_CHAIN)
+      if(trace(sb, node, x, y, tx, ty))
+        return -1;
+  }
+  return linkend(sb, node);
+}
+
+/*
+  Follow a chain out from a node.
+  Params: sb - the graph under construction
+          node - the node we start from
+          px, py - the node pixel we leave from
+          cx, cy - first pixel of the chain
+  Returns: 0 on success, -1 on out of memory.
+  Notes: the chain ends at the first pixel which touches another node,
+         or when there are no more chain pixels. It may come back to
+         its own node as a loop, but only after two pixels. If it just
+         stops, the last pixel becomes a line end. If the last pixel
+         is a fork, it becomes a branch point, or part of the branch
+         point we left from if we only took one step.
+*/
+static int trace(SGBUILD *sb, int node, int px, int py, int cx, int cy)
+{
+  int width = sb->width;
+  int start = sb->Nbuff;
+  int N = 0;
+  double length = 0;
+  double rsum = 0;
+  int prevx = px, prevy = py;
+  int endnode = -1;
+  int ex = 0, ey = 0;
+  int step;
+  int tx, ty;
+  int i;
+
+  for(;;)
+  {
+    sb->tags[cy*width+cx] = TAG_VISITED;
+    sb->Nchain--;
+    if(pushpixel(sb, cx, cy))
+      return -1;
+    N++;
+    length += steplength(prevx, prevy, cx, cy);
+    if(sb->radius)
+      rsum += sb->radius[cy*width+cx];
+
+    step = nextstep(sb, node, cx, cy, &tx, &ty, &endnode);
+    if(step == STEP_ERROR)
+      return -1;
+    if(step != STEP_CHAIN)
+      break;
+    prevx = cx;
+    prevy = cy;
+    cx = tx;
+    cy = ty;
+  }
+
+  if(step == STEP_NODE)
+  {
+    ex = tx;
+    ey = ty;
+  }
+  /* our own node if we have gone far enough */
+  for(i=0;i<8 && step == STEP_END && endnode < 0 && N >= 2;i++)
+  {
+    tx = cx + ndx[i];
+    ty = cy + ndy[i];
+    if(gettag(sb, tx, ty) == node + 1)
+    {
+      endnode = node;
+      ex = tx;
+      ey = ty;
+    }
+  }
+
+  if(endnode < 0)
+  {
+    /* dead end or fork, the last pixel is a node of its own */
+    sb->Nbuff--;
+    N--;
+    length -= steplength(prevx, prevy, cx, cy);
+    if(sb->radius)
+      rsum -= sb->radius[cy*width+cx];
+    if(step == STEP_JUNCTION && N == 0 && sb->nodes[node].type == SKEL_BRANCH)
+    {
+      sb->tags[cy*width+cx] = node + 1;
+      return branchpoint(sb, node, cx, cy, node);
+    }
+    endnode = addnode(sb, cx, cy, step == STEP_JUNCTION ? SKEL_BRANCH : SKEL_END);
+    if(endnode < 0)
+      return -1;
+    sb->tags[cy*width+cx] = endnode + 1;
+    ex = cx;
+    ey = cy;
+    cx = prevx;
+    cy = prevy;
+  }
+  length += steplength(cx, cy, ex, ey);
+
+  if(addedge(sb, node, endnode, py*width+px, ey*width+ex, start, N, length, rsum) < 0)
+    return -1;
+  if(step == STEP_JUNCTION)
+    return branchpoint(sb, endnode, ex, ey, node);
+
+  return 0;
+}
+
+/*
+  Decide where a trace goes after a chain pixel.
+  Params: sb - the graph under construction
+          node - the node the trace started from
+          cx, cy - the chain pixel
+          nx, ny - return for the next pixel, chain or node
+          endnode - return for the node we stop at, -1 if none
+  Returns: STEP_CHAIN, STEP_NODE, STEP_JUNCTION, STEP_END or STEP_ERROR.
+  Notes: a pixel touching another node stops the trace. It is a fork
+         if it touches two other nodes, or a chain pixel the node
+         doesn't, or two chain pixels which don't touch each other.
+         Otherwise a chain the trace doesn't take would be cut off.
+*/
+static int nextstep(SGBUILD *sb, int node, int cx, int cy, int *nx, int *ny, int *endnode)
+{
+  int width = sb->width;
+  int other = -1;
+  int chain[8];
+  int Nchain = 0;
+  int tx, ty;
+  int m;
+  int i, j;
+
+  *endnode = -1;
+  for(i=0;i<8;i++)
+  {
+    tx = cx + ndx[i];
+    ty = cy + ndy[i];
+    m = nodeat(sb, tx, ty);
+    if(m == -2)
+      return STEP_ERROR;
+    if(m >= 0 && m != node)
+    {
+      if(other >= 0 && m != other)
+        return STEP_JUNCTION;
+      if(other < 0)
+      {
+        other = m;
+        *nx = tx;
+        *ny = ty;
+      }
+    }
+    else if(m < 0 && gettag(sb, tx, ty) == TAG_CHAIN)
+      chain[Nchain++] = ty*width+tx;
+  }
+
+  if(other >= 0)
+  {
+    for(i=0;i<Nchain;i++)
+    {
+      for(j=0;j<8;j++)
+        if(gettag(sb, chain[i] % width + ndx[j], chain[i] / width + ndy[j]) == other + 1)
+          break;
+      if(j == 8)
+        return STEP_JUNCTION;
+    }
+    *endnode = other;
+    return STEP_NODE;
+  }
+
+  if(Nchain == 0)
+    return STEP_END;
+  for(i=0;i<Nchain;i++)
+    for(j=i+1;j<Nchain;j++)
+      if(!adjacent(width, chain[i], chain[j]))
+        return STEP_JUNCTION;
+  *nx = chain[0] % width;
+  *ny = chain[0] / width;
+  return STEP_CHAIN;
+}
+
+/*
+  Finish a chain pixel which has become part of a branch point.
+  Params: sb - the graph under construction
+          node - the branch point
+          x, y - the pixel
+          except - a node it already has an edge to
+  Returns: 0 on success, -1 on out of memory.
+  Notes: it is joined straight to the other nodes it touches, and its
+         chains are traced from the main loop.
+*/
+static int branchpoint(SGBUILD *sb, int node, int x, int y, int except)
+{
+  int width = sb->width;
+  int linked[8];
+  int Nlinked = 0;
+  int tx, ty;
+  int m;
+  int i, j;
+
+  for(i=0;i<8;i++)
+  {
+    tx = x + ndx[i];
+    ty = y + ndy[i];
+    m = nodeat(sb, tx, ty);
+    if(m == -2)
+      return -1;
+    if(m < 0 || m == node || m == except)
+      continue;
+    for(j=0;j<Nlinked;j++)
+      if(linked[j] == m)
+        break;
+    if(j < Nlinked)
+      continue;
+    linked[Nlinked++] = m;
+    if(addedge(sb, node, m, y*width+x, ty*width+tx, sb->Nbuff, 0,
+               steplength(x, y, tx, ty), 0.0) < 0)
+      return -1;
+  }
+
+  return pushint(&sb->pending, &sb->Npending, &sb->pendingcapacity, y*width+x);
+}
+
+/*
+  Join a line end which touches another node directly.
+  Params: sb - the graph under construction
+          node - the node
+  Returns: 0 on success, -1 on out of memory.
+  Notes: called once the node's chains have been traced, so a line end
+         still without an edge has no chain next to it. The edge has
+         no chain pixels.
+*/
+static int linkend(SGBUILD *sb, int node)
+{
+  int width = sb->width;
+  int x = sb->nodes[node].x;
+  int y = sb->nodes[node].y;
+  int tx, ty;
+  int m;
+  int i;
+
+  if(sb->nodes[node].type != SKEL_END || sb->nodes[node].degree != 0)
+    return 0;
+  for(i=0;i<8;i++)
+  {
+    tx = x + ndx[i];
+    ty = y + ndy[i];
+    m = nodeat(sb, tx, ty);
+    if(m == -2)
+      return -1;
+    if(m >= 0 && m != node)
+      return addedge(sb, node, m, y*width+x, ty*width+tx, sb->Nbuff, 0,
+                     steplength(x, y, tx, ty), 0.0) < 0 ? -1 : 0;
+  }
+  return 0;
+}
+
+/*
+  Prune short spurs.
+  Params: sb - the graph under construction
+          minspur - spurs shorter than this go
+  Returns: 0 on success, -1 on out of memory.
+  Notes: a branch point left with two edges is dissolved, the edges
+         joined through it.
+*/
+static int prune(SGBUILD *sb, double minspur)
+{
+  SGEDGE *e;
+  SKELNODE *a, *b;
+  int *incident = 0;
+  int Nedges = sb->Nedges;
+  int e1, e2;
+  int i;
+
+  for(i=0;i<Nedges;i++)
+  {
+    e = &sb->edges[i];
+    if(e->node1 == e->node2 || e->length >= minspur)
+      continue;
+    a = &sb->nodes[e->node1];
+    b = &sb->nodes[e->node2];
+    if(a->type == SKEL_END && b->type == SKEL_END)
+      continue;
+    if(b->type == SKEL_END)
+    {
+      a = b;
+      b = &sb->nodes[e->node1];
+    }
+    if(a->type != SKEL_END || a->degree != 1 || b->type != SKEL_BRANCH)
+      continue;
+    a->type = NODE_DEAD;
+    a->degree = 0;
+    b->degree--;
+    e->mergedinto = EDGE_PRUNED;
+  }
+
+  incident = malloc(sb->Nnodes * 2 * sizeof(int) + 1);
+  if(!incident)
+    return -1;
+  for(i=0;i<sb->Nnodes*2;i++)
+    incident[i] = -1;
+  for(i=0;i<Nedges;i++)
+  {
+    e = &sb->edges[i];
+    if(e->mergedinto != EDGE_ALIVE || e->node1 == e->node2)
+      continue;
+    if(sb->nodes[e->node1].degree == 2 && sb->nodes[e->node1].type == SKEL_BRANCH)
+      incident[e->node1*2 + (incident[e->node1*2] >= 0)] = i;
+    if(sb->nodes[e->node2].degree == 2 && sb->nodes[e->node2].type == SKEL_BRANCH)
+      incident[e->node2*2 + (incident[e->node2*2] >= 0)] = i;
+  }
+
+  for(i=0;i<sb->Nnodes;i++)
+  {
+    if(sb->nodes[i].type != SKEL_BRANCH || sb->nodes[i].degree != 2 || incident[i*2+1] < 0)
+      continue;
+    e1 = resolveedge(sb, incident[i*2]);
+    e2 = resolveedge(sb, incident[i*2+1]);
+    if(e1 < 0 || e2 < 0 || e1 == e2)
+      continue;
+    if(mergeedges(sb, i, e1, e2))
+    {
+      free(incident);
+      return -1;
+    }
+  }
+
+  free(incident);
+  return 0;
+}
+
+/*
+  Join two edges through a node of degree two, and remove the node.
+  Params: sb - the graph under construction
+          node - the node
+          e1, e2 - the two edges at it
+  Returns: 0 on success, -1 on out of memory.
+  Notes: the node's own pixels between the two edges go into the chain.
+*/
+static int mergeedges(SGBUILD *sb, int node, int e1, int e2)
+{
+  SGEDGE a, b;
+  int start = sb->Nbuff;
+  int from, to;
+  int fromattach, toattach;
+  int ina, inb;
+  int Npath;
+  double length, rsum;
+  int newedge;
+  int i;
+
+  a = sb->edges[e1];
+  b = sb->edges[e2];
+  /* a runs into the node, b out of it */
+  from = a.node2 == node ? a.node1 : a.node2;
+  fromattach = a.node2 == node ? a.attach1 : a.attach2;
+  ina = a.node2 == node ? a.attach2 : a.attach1;
+  to = b.node1 == node ? b.node2 : b.node1;
+  toattach = b.node1 == node ? b.attach2 : b.attach1;
+  inb = b.node1 == node ? b.attach1 : b.attach2;
+  for(i=0;i<a.N;i++)
+  {
+    if(a.node2 == node)
+    {
+      if(pushpixel(sb, sb->bx[a.start + i], sb->by[a.start + i]))
+        return -1;
+    }
+    else if(pushpixel(sb, sb->bx[a.start + a.N - 1 - i], sb->by[a.start + a.N - 1 - i]))
+      return -1;
+  }
+  length = a.length + b.length;
+  rsum = a.rsum + b.rsum;
+  Npath = pushnodepath(sb, node, ina, inb, &length, &rsum);
+  if(Npath < 0)
+    return -1;
+  for(i=0;i<b.N;i++)
+  {
+    if(b.node1 == node)
+    {
+      if(pushpixel(sb, sb->bx[b.start + i], sb->by[b.start + i]))
+        return -1;
+    }
+    else if(pushpixel(sb, sb->bx[b.start + b.N - 1 - i], sb->by[b.start + b.N - 1 - i]))
+      return -1;
+  }
+
+  newedge = addedge(sb, from, to, fromattach, toattach, start, a.N + Npath + b.N, length, rsum);
+  if(newedge < 0)
+    return -1;
+  sb->edges[e1].mergedinto = newedge;
+  sb->edges[e2].mergedinto = newedge;
+  /* addedge() counted the ends again */
+  sb->nodes[from].degree--;
+  sb->nodes[to].degree--;
+  sb->nodes[node].type = NODE_DEAD;
+  sb->nodes[node].degree = 0;
+
+  return 0;
+}
+
+/*
+  Add the shortest path through a node's pixels to the chain buffer.
+  Params: sb - the graph under construction
+          node - the node
+          from - pixel of the node the path starts at
+          to - pixel of the node the path ends at
+          length - in/out, has the steps along the path added
+          rsum - in/out, has the radii along the path added
+  Returns: the number of pixels added, -1 on out of memory.
+  Notes: a breadth first search over the node's pixels, which are
+         usually only a few. The queue holds pairs of pixel and the
+         queue position it was reached from.
+*/
+static int pushnodepath(SGBUILD *sb, int node, int from, int to, double *length, double *rsum)
+{
+  int width = sb->width;
+  int *queue;
+  int Npath = 0;
+  int head;
+  int pix;
+  int tx, ty;
+  int i, j;
+
+  sb->Nqueue = 0;
+  if(pushint(&sb->queue, &sb->Nqueue, &sb->queuecapacity, from) ||
+     pushint(&sb->queue, &sb->Nqueue, &sb->queuecapacity, -1))
+    return -1;
+  for(head=0;head<sb->Nqueue && sb->queue[head] != to;head+=2)
+  {
+    pix = sb->queue[head];
+    for(i=0;i<8;i++)
+    {
+      tx = pix % width + ndx[i];
+      ty = pix / width + ndy[i];
+      if(gettag(sb, tx, ty) != node + 1)
+        continue;
+      for(j=0;j<sb->Nqueue;j+=2)
+        if(sb->queue[j] == ty*width+tx)
+          break;
+      if(j < sb->Nqueue)
+        continue;
+      if(pushint(&sb->queue, &sb->Nqueue, &sb->queuecapacity, ty*width+tx) ||
+         pushint(&sb->queue, &sb->Nqueue, &sb->queuecapacity, head))
+        return -1;
+    }
+  }
+  if(head >= sb->Nqueue)
+    head = 0;
+
+  /* back from the end, filling the chain buffer from the far end */
+  queue = sb->queue;
+  for(i=head;i>=0;i=queue[i+1])
+    if(pushpixel(sb, 0, 0))
+      return -1;
+  j = sb->Nbuff - 1;
+  for(i=head;i>=0;i=queue[i+1])
+  {
+    sb->bx[j] = queue[i] % width;
+    sb->by[j] = queue[i] / width;
+    if(sb->radius)
+      *rsum += sb->radius[queue[i]];
+    if(i != head)
+      *length += steplength(sb->bx[j], sb->by[j], sb->bx[j+1], sb->by[j+1]);
+    j--;
+    Npath++;
+  }
+
+  return Npath;
+}
+
+/*
+  Follow an edge through merges to the edge which replaced it.
+  Returns: the live edge, -1 if it was pruned.
+*/
+static int resolveedge(SGBUILD *sb, int e)
+{
+  while(sb->edges[e].mergedinto >= 0)
+    e = sb->edges[e].mergedinto;
+  return sb->edges[e].mergedinto == EDGE_PRUNED ? -1 : e;
+}
+
+/*
+  Copy the live nodes and edges to the output graph.
+*/
+static SKELETONGRAPH *buildgraph(SGBUILD *sb)
+{
+  SKELETONGRAPH *sg;
+  SGEDGE *e;
+  SKELEDGE *out;
+  int *remap = 0;
+  int Nnodes = 0, Nedges = 0, Npixels = 0;
+  int i, j;
+
+  sg = malloc(sizeof(SKELETONGRAPH));
+  if(!sg)
+    return 0;
+  sg->nodes = 0;
+  sg->edges = 0;
+  sg->xbuff = 0;
+  sg->ybuff = 0;
+
+  remap = malloc(sb->Nnodes * sizeof(int) + 1);
+  if(!remap)
+    goto out_of_memory;
+  for(i=0;i<sb->Nnodes;i++)
+    remap[i] = sb->nodes[i].type == NODE_DEAD ? -1 : Nnodes++;
+  for(i=0;i<sb->Nedges;i++)
+    if(sb->edges[i].mergedinto == EDGE_ALIVE)
+    {
+      Nedges++;
+      Npixels += sb->edges[i].N;
+    }
+
+  sg->nodes = malloc(Nnodes * sizeof(SKELNODE) + 1);
+  sg->edges = malloc(Nedges * sizeof(SKELEDGE) + 1);
+  sg->xbuff = malloc(Npixels * sizeof(int) + 1);
+  sg->ybuff = malloc(Npixels * sizeof(int) + 1);
+  if(!sg->nodes || !sg->edges || !sg->xbuff || !sg->ybuff)
+    goto out_of_memory;
+
+  for(i=0;i<sb->Nnodes;i++)
+    if(remap[i] >= 0)
+      sg->nodes[remap[i]] = sb->nodes[i];
+
+  Npixels = 0;
+  Nedges = 0;
+  for(i=0;i<sb->Nedges;i++)
+  {
+    e = &sb->edges[i];
+    if(e->mergedinto != EDGE_ALIVE)
+      continue;
+    out = &sg->edges[Nedges++];
+    out->node1 = remap[e->node1];
+    out->node2 = remap[e->node2];
+    out->N = e->N;
+    out->x = sg->xbuff + Npixels;
+    out->y = sg->ybuff + Npixels;
+    for(j=0;j<e->N;j++)
+    {
+      out->x[j] = sb->bx[e->start + j];
+      out->y[j] = sb->by[e->start + j];
+    }
+    Npixels += e->N;
+    out->length = e->length;
+    out->radius = (sb->radius && e->N > 0) ? e->rsum / e->N : 0.0;
+  }
+  sg->Nnodes = Nnodes;
+  sg->Nedges = Nedges;
+
+  free(remap);
+  return sg;
+out_of_memory:
+  free(remap);
+  killskeletongraph(sg);
+  return 0;
+}
+
+/*
+  Add a node.
+  Returns: its index, -1 on out of memory.
+*/
+static int addnode(SGBUILD *sb, int x, int y, int type)
+{
+  SKELNODE *temp;
+
+  if(sb->Nnodes == sb->nodecapacity)
+  {
+    temp = realloc(sb->nodes, (sb->nodecapacity * 2 + 16) * sizeof(SKELNODE));
+    if(!temp)
+      return -1;
+    sb->nodes = temp;
+    sb->nodecapacity = sb->nodecapacity * 2 + 16;
+  }
+  sb->nodes[sb->Nnodes].x = x;
+  sb->nodes[sb->Nnodes].y = y;
+  sb->nodes[sb->Nnodes].type = type;
+  sb->nodes[sb->Nnodes].degree = 0;
+
+  return sb->Nnodes++;
+}
+
+/*
+  Add an edge, and count it in the degrees of its nodes.
+  Returns: its index, -1 on out of memory.
+*/
+static int addedge(SGBUILD *sb, int node1, int node2, int attach1, int attach2,
+                   int start, int N, double length, double rsum)
+{
+  SGEDGE *temp;
+  SGEDGE *e;
+
+  if(sb->Nedges == sb->edgecapacity)
+  {
+    temp = realloc(sb->edges, (sb->edgecapacity * 2 + 16) * sizeof(SGEDGE));
+    if(!temp)
+      return -1;
+    sb->edges = temp;
+    sb->edgecapacity = sb->edgecapacity * 2 + 16;
+  }
+  e = &sb->edges[sb->Nedges];
+  e->node1 = node1;
+  e->node2 = node2;
+  e->attach1 = attach1;
+  e->attach2 = attach2;
+  e->start = start;
+  e->N = N;
+  e->length = length;
+  e->rsum = rsum;
+  e->mergedinto = EDGE_ALIVE;
+  sb->nodes[node1].degree++;
+  sb->nodes[node2].degree++;
+
+  return sb->Nedges++;
+}
+
+/*
+  Add an int to a growing buffer.
+  Returns: 0 on success, -1 on out of memory.
+*/
+static int pushint(int **buff, int *N, int *capacity, int value)
+{
+  int *temp;
+
+  if(*N == *capacity)
+  {
+    temp = realloc(*buff, (*capacity * 2 + 16) * sizeof(int));
+    if(!temp)
+      return -1;
+    *buff = temp;
+    *capacity = *capacity * 2 + 16;
+  }
+  (*buff)[(*N)++] = value;
+
+  return 0;
+}
+
+/*
+  Add a pixel to the chain buffer.
+  Returns: 0 on success, -1 on out of memory.
+*/
+static int pushpixel(SGBUILD *sb, int x, int y)
+{
+  int *temp;
+  int capacity;
+
+  if(sb->Nbuff == sb->buffcapacity)
+  {
+    capacity = sb->buffcapacity * 2 + 64;
+    temp = realloc(sb->bx, capacity * sizeof(int));
+    if(!temp)
+      return -1;
+    sb->bx = temp;
+    temp = realloc(sb->by, capacity * sizeof(int));
+    if(!temp)
+      return -1;
+    sb->by = temp;
+    sb->buffcapacity = capacity;
+  }
+  sb->bx[sb->Nbuff] = x;
+  sb->by[sb->Nbuff] = y;
+  sb->Nbuff++;
+
+  return 0;
+}
+
+/*
+  whether two pixels, given as y * width + x, are 8-neighbours
+*/
+static int adjacent(int width, int pix1, int pix2)
+{
+  return abs(pix1 % width - pix2 % width) <= 1 && abs(pix1 / width - pix2 / width) <= 1;
+}
+
+/*
+  length of a step between neighbouring pixels
+*/
+static double steplength(int x1, int y1, int x2, int y2)
+{
+  return (x1 != x2 && y1 != y2) ? sqrt(2.0) : 1.0;
+}
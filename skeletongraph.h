@@ -0,0 +1,48 @@
+#ifndef skeletongraph_h
+#define skeletongraph_h
+
+/* node types */
+#define SKEL_ISOLATED 0
+#define SKEL_END 1
+#define SKEL_BRANCH 2
+#define SKEL_LOOP 3
+
+/*
+  A node of a skeleton graph, a line end or a branch point.
+*/
+typedef struct
+{
+  int x;          /**< x co-ordinate */
+  int y;          /**< y co-ordinate */
+  int type;       /**< SKEL_ISOLATED, SKEL_END, SKEL_BRANCH or SKEL_LOOP */
+  int degree;     /**< number of edge ends at the node, a loop counts twice */
+} SKELNODE;
+
+/*
+  An edge of a skeleton graph, a chain of pixels between two nodes.
+*/
+typedef struct
+{
+  int node1;      /**< node at the start */
+  int node2;      /**< node at the end, may be node1 for a loop */
+  int N;          /**< number of pixels in the chain, not counting the nodes */
+  int *x;         /**< chain x co-ordinates, from node1 to node2 */
+  int *y;         /**< chain y co-ordinates */
+  double length;  /**< length from node to node, diagonal steps count root 2 */
+  double radius;  /**< mean distance transform along the chain, 0 if not asked for */
+} SKELEDGE;
+
+typedef struct
+{
+  int Nnodes;        /**< number of nodes */
+  SKELNODE *nodes;   /**< the nodes */
+  int Nedges;        /**< number of edges */
+  SKELEDGE *edges;   /**< the edges */
+  int *xbuff;        /**< storage for the edge chains */
+  int *ybuff;
+} SKELETONGRAPH;
+
+SKELETONGRAPH *skeletongraph(unsigned char *skel, int width, int height, float *radius, double minspur);
+void killskeletongraph(SKELETONGRAPH *sg);
+
+#endif
@@ -0,0 +1,444 @@
+/**@file
+   Streaming connected component labelling.
+
+   labelconnected() needs the whole image, and a label for every pixel.
+   Here the image is fed in one row at a time, and can be of any height.
+   We keep the labels of the previous row only, and a record for each
+   component which could still grow. When a row arrives which does not
+   touch a component, that component is finished, and it is passed to
+   the caller's callback with its statistics, then forgotten.
+   So memory is proportional to the width plus the number of live
+   components.
+
+   The statistics are the same as labelconnectedstats() gives.
+   Co-ordinates are relative to the first row passed in.
+
+   By Malcolm McLean.
+*/
+#include <stdlib.h>
+#include <string.h>
+
+#include "streamlabel.h"
+
+typedef struct
+{
+  COMPONENTSTATS stats;  /* statistics so far, bbwidth, bbheight hold right, bottom */
+  int parent;            /* union-find parent, own index for a root */
+  int lastrow;           /* last row with pixels in this component, -1 if free */
+  int next;              /* next in free or pending list */
+} SLNODE;
+
+struct streamlabel
+{
+  int width;              /* image width */
+  int connex;             /* 4 or 8 connectivity */
+  STREAMLABEL_CALLBACK emit; /* callback for finished components */
+  void *ptr;              /* callback context pointer */
+  int y;                  /* index of the row to come */
+  unsigned char *rows;    /* last two rows, then the row coming in, as 0 and 1 */
+  int *prevlabels;        /* labels of the last row */
+  int *labels;            /* labels of the row coming in */
+  SLNODE *nodes;          /* component records */
+  int Nnodes;             /* number of records allocated */
+  int freelist;           /* first free record, -1 for none */
+  int pending;            /* records merged away this row, free at end of row */
+};
+
+static int newnode(STREAMLABEL *sl, int y);
+static int findroot(STREAMLABEL *sl, int node);
+static int mergenodes(STREAMLABEL *sl, int a, int b);
+static void addrun(COMPONENTSTATS *cs, int y, int start, int end);
+static void perimeterrow(STREAMLABEL *sl, unsigned char *up, unsigned char *mid, unsigned char *down);
+static void emitfinished(STREAMLABEL *sl, int y);
+static void emit(STREAMLABEL *sl, int node);
+
+/**
+  Create a streaming labeller.
+
+  @param width - image width
+  @param connex - 4 or 8 connectivity
+  @param emit - function called with each finished component
+  @param ptr - context pointer passed to emit
+  @returns The labeller, 0 on out of memory.
+*/
+STREAMLABEL *streamlabel(int width, int connex, STREAMLABEL_CALLBACK emit, void *ptr)
+{
+  STREAMLABEL *answer;
+
+  answer = malloc(sizeof(STREAMLABEL));
+  if(!answer)
+    return 0;
+  answer->width = width;
+  answer->connex = connex;
+  answer->emit = emit;
+  answer->ptr = ptr;
+  answer->y = 0;
+  answer->rows = calloc(3 * width + 1, 1);
+  answer->prevlabels = calloc(width + 1, sizeof(int));
+  answer->labels = calloc(width + 1, sizeof(int));
+  answer->nodes = 0;
+  answer->Nnodes = 0;
+  answer->freelist = -1;
+  answer->pending = -1;
+  if(!answer->rows || !answer->prevlabels || !answer->labels)
+  {
+    killstreamlabel(answer);
+    return 0;
+  }
+
+  return answer;
+}
+
+/**
+  Streaming labeller destructor.
+
+  @param sl - the labeller to destroy.
+  @note Components not yet finished are discarded, call streamlabel_finish()
+    first to have them reported.
+*/
+void killstreamlabel(STREAMLABEL *sl)
+{
+  if(sl)
+  {
+    free(sl->rows);
+    free(sl->prevlabels);
+    free(sl->labels);
+    free(sl->nodes);
+    free(sl);
+  }
+}
+
+/**
+  Add the next row of the image.
+
+  @param sl - the labeller
+  @param[in] row - the row, width pixels, non-zero for set
+  @returns 0 on success, -1 on out of memory.
+  @note Components which the row doesn't touch are finished, and
+    reported before we return.
+*/
+int streamlabel_addrow(STREAMLABEL *sl, unsigned char *row)
+{
+  int width = sl->width;
+  unsigned char *upup = sl->rows;
+  unsigned char *up = sl->rows + width;
+  unsigned char *mid = sl->rows + 2 * width;
+  int *prevlabels = sl->prevlabels;
+  int *labels = sl->labels;
+  int y = sl->y;
+  int reach = sl->connex == 8 ? 1 : 0;
+  int start, end;
+  int label;
+  int x, ix;
+  int lo, hi;
+  int *temp;
+
+  for(x=0;x<width;x++)
+    mid[x] = row[x] ? 1 : 0;
+
+  /* label the runs, merging with the runs they touch above */
+  x = 0;
+  while(x < width)
+  {
+    if(!mid[x])
+    {
+      labels[x++] = -1;
+      continue;
+    }
+    start = x;
+    while(x < width && mid[x])
+      x++;
+    end = x - 1;
+
+    label = -1;
+    if(y > 0)
+    {
+      lo = start - reach > 0 ? start - reach : 0;
+      hi = end + reach < width - 1 ? end + reach : width - 1;
+      for(ix=lo;ix<=hi;ix++)
+        if(up[ix] && (ix == lo || !up[ix-1]))
+          label = label == -1 ? findroot(sl, prevlabels[ix]) : mergenodes(sl, label, prevlabels[ix]);
+    }
+    if(label == -1)
+    {
+      label = newnode(sl, y);
+      if(label == -1)
+        return -1;
+      sl->nodes[label].stats.firstx = start;
+      sl->nodes[label].stats.firsty = y;
+      sl->nodes[label].stats.x = start;
+      sl->nodes[label].stats.y = y;
+      sl->nodes[label].stats.bbwidth = end;
+      sl->nodes[label].stats.bbheight = y;
+    }
+    addrun(&sl->nodes[label].stats, y, start, end);
+    sl->nodes[label].lastrow = y;
+    for(ix=start;ix<=end;ix++)
+      labels[ix] = label;
+  }
+
+  /* now we have the row below it, the last row's perimeter is known */
+  if(y > 0)
+    perimeterrow(sl, y > 1 ? upup : 0, up, mid);
+  emitfinished(sl, y);
+
+  /* point this row's labels at roots, then the merged records can go */
+  for(x=0;x<width;x++)
+    if(labels[x] != -1)
+      labels[x] = findroot(sl, labels[x]);
+  while(sl->pending != -1)
+  {
+    label = sl->pending;
+    sl->pending = sl->nodes[label].next;
+    sl->nodes[label].lastrow = -1;
+    sl->nodes[label].next = sl->freelist;
+    sl->freelist = label;
+  }
+
+  memmove(sl->rows, sl->rows + width, 2 * width);
+  temp = sl->prevlabels;
+  sl->prevlabels = sl->labels;
+  sl->labels = temp;
+  sl->y++;
+
+  return 0;
+}
+
+/**
+  Finish the image.
+
+  @param sl - the labeller
+  @returns 0 on success, -1 on error.
+  @note Every component still open is reported. The labeller is then
+    ready to start a new image.
+*/
+int streamlabel_finish(STREAMLABEL *sl)
+{
+  int width = sl->width;
+  int x;
+
+  if(sl->y > 0)
+  {
+    memset(sl->rows + 2 * width, 0, width);
+    perimeterrow(sl, sl->y > 1 ? sl->rows : 0, sl->rows + width, sl->rows + 2 * width);
+    for(x=0;x<width;x++)
+      sl->labels[x] = -1;
+    emitfinished(sl, sl->y);
+  }
+
+  sl->y = 0;
+  memset(sl->rows, 0, 3 * width);
+  free(sl->nodes);
+  sl->nodes = 0;
+  sl->Nnodes = 0;
+  sl->freelist = -1;
+  sl->pending = -1;
+
+  return 0;
+}
+
+/*
+  Get a new component record.
+  Params: sl - the labeller
+          y - the current row
+  Returns: index of the record, -1 on out of memory.
+  Notes: the record array grows geometrically, freed records are
+    reused first.
+*/
+static int newnode(STREAMLABEL *sl, int y)
+{
+  SLNODE *temp;
+  int answer;
+  int N;
+  int i;
+
+  if(sl->freelist == -1)
+  {
+    N = sl->Nnodes + sl->Nnodes/2 + 16;
+    temp = realloc(sl->nodes, N * sizeof(SLNODE));
+    if(!temp)
+      return -1;
+    sl->nodes = temp;
+    for(i=N-1;i>=sl->Nnodes;i--)
+    {
+      sl->nodes[i].lastrow = -1;
+      sl->nodes[i].next = sl->freelist;
+      sl->freelist = i;
+    }
+    sl->Nnodes = N;
+  }
+
+  answer = sl->freelist;
+  sl->freelist = sl->nodes[answer].next;
+  memset(&sl->nodes[answer].stats, 0, sizeof(COMPONENTSTATS));
+  sl->nodes[answer].parent = answer;
+  sl->nodes[answer].lastrow = y;
+  sl->nodes[answer].next = -1;
+
+  return answer;
+}
+
+/*
+  Find the root record of a component, halving the path as we go.
+*/
+static int findroot(STREAMLABEL *sl, int node)
+{
+  SLNODE *nodes = sl->nodes;
+
+  while(nodes[node].parent != node)
+  {
+    nodes[node].parent = nodes[nodes[node].parent].parent;
+    node = nodes[node].parent;
+  }
+  return node;
+}
+
+/*
+  Merge two components.
+  Params: sl - the labeller
+          a - a root record
+          b - any record of the other component
+  Returns: the root of the merged component, which is a.
+  Notes: b's root keeps its index until the end of the row, because
+    the last row's labels still refer to it.
+*/
+static int mergenodes(STREAMLABEL *sl, int a, int b)
+{
+  COMPONENTSTATS *sa, *sb;
+
+  b = findroot(sl, b);
+  if(a == b)
+    return a;
+  sa = &sl->nodes[a].stats;
+  sb = &sl->nodes[b].stats;
+
+  if(sb->firsty < sa->firsty || (sb->firsty == sa->firsty && sb->firstx < sa->firstx))
+  {
+    sa->firstx = sb->firstx;
+    sa->firsty = sb->firsty;
+  }
+  if(sa->x > sb->x)
+    sa->x = sb->x;
+  if(sa->y > sb->y)
+    sa->y = sb->y;
+  if(sa->bbwidth < sb->bbwidth)
+    sa->bbwidth = sb->bbwidth;
+  if(sa->bbheight < sb->bbheight)
+    sa->bbheight = sb->bbheight;
+  sa->area += sb->area;
+  sa->perimeter += sb->perimeter;
+  sa->m10 += sb->m10;
+  sa->m01 += sb->m01;
+  sa->m20 += sb->m20;
+  sa->m11 += sb->m11;
+  sa->m02 += sb->m02;
+  if(sl->nodes[a].lastrow < sl->nodes[b].lastrow)
+    sl->nodes[a].lastrow = sl->nodes[b].lastrow;
+
+  sl->nodes[b].parent = a;
+  sl->nodes[b].next = sl->pending;
+  sl->pending = b;
+
+  return a;
+}
+
+/*
+  Add a run of pixels to a component's statistics.
+  Params: cs - the statistics
+          y - the row
+          start - first pixel of run
+          end - last pixel of run
+*/
+static void addrun(COMPONENTSTATS *cs, int y, int start, int end)
+{
+  double N = end - start + 1;
+  double sumx, sumxx;
+
+  sumx = N * (start + end) / 2.0;
+  /* sum of squares 0 to n is n(n+1)(2n+1)/6 */
+  sumxx = ((double) end * (end + 1) * (2.0 * end + 1)
+    - (double) (start - 1) * start * (2.0 * start - 1)) / 6.0;
+
+  if(cs->x > start)
+    cs->x = start;
+  if(cs->bbwidth < end)
+    cs->bbwidth = end;
+  cs->bbheight = y;
+  cs->area += end - start + 1;
+  cs->m10 += sumx;
+  cs->m01 += N * y;
+  cs->m20 += sumxx;
+  cs->m11 += sumx * y;
+  cs->m02 += N * y * y;
+}
+
+/*
+  Count the perimeter pixels of the last row.
+  Params: sl - the labeller
+          up - the row above it, 0 if none
+          mid - the last row
+          down - the row below it
+  Notes: a perimeter pixel has a clear pixel among its 8 neighbours,
+    pixels off the image count as clear.
+*/
+static void perimeterrow(STREAMLABEL *sl, unsigned char *up, unsigned char *mid, unsigned char *down)
+{
+  int width = sl->width;
+  int x;
+  int all;
+
+  for(x=0;x<width;x++)
+  {
+    if(!mid[x])
+      continue;
+    if(x == 0 || x == width - 1 || !up)
+      all = 0;
+    else
+      all = up[x-1] & up[x] & up[x+1] & mid[x-1] & mid[x+1] & down[x-1] & down[x] & down[x+1];
+    if(!all)
+      sl->nodes[findroot(sl, sl->prevlabels[x])].stats.perimeter++;
+  }
+}
+
+/*
+  Report the components of the last row which didn't reach row y.
+*/
+static void emitfinished(STREAMLABEL *sl, int y)
+{
+  int *prevlabels = sl->prevlabels;
+  unsigned char *up = sl->rows + sl->width;
+  int root;
+  int x;
+
+  if(y == 0)
+    return;
+  for(x=0;x<sl->width;x++)
+  {
+    if(!up[x] || (x > 0 && up[x-1]))
+      continue;
+    root = findroot(sl, prevlabels[x]);
+    if(sl->nodes[root].lastrow != y && sl->nodes[root].lastrow != -1)
+    {
+      emit(sl, root);
+      sl->nodes[root].lastrow = -1;
+      sl->nodes[root].next = sl->freelist;
+      sl->freelist = root;
+    }
+  }
+}
+
+/*
+  Pass a finished component to the callback.
+*/
+static void emit(STREAMLABEL *sl, int node)
+{
+  COMPONENTSTATS cs;
+
+  cs = sl->nodes[node].stats;
+  cs.bbwidth = cs.bbwidth - cs.x + 1;
+  cs.bbheight = cs.bbheight - cs.y + 1;
+  cs.cx = cs.m10 / cs.area;
+  cs.cy = cs.m01 / cs.area;
+  if(sl->emit)
+    (*sl->emit)(sl->ptr, &cs);
+}
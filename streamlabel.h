@@ -0,0 +1,19 @@
+#ifndef streamlabel_h
+#define streamlabel_h
+
+#include "binaryutils.h"
+
+/*
+  Called once for each component, as soon as it is finished.
+  The stats are only valid for the duration of the call.
+*/
+typedef void (*STREAMLABEL_CALLBACK)(void *ptr, COMPONENTSTATS *stats);
+
+typedef struct streamlabel STREAMLABEL;
+
+STREAMLABEL *streamlabel(int width, int connex, STREAMLABEL_CALLBACK emit, void *ptr);
+void killstreamlabel(STREAMLABEL *sl);
+int streamlabel_addrow(STREAMLABEL *sl, unsigned char *row);
+int streamlabel_finish(STREAMLABEL *sl);
+
+#endif
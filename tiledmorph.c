@@ -0,0 +1,255 @@
+/**@file
+   Multithreaded morphology.
+
+   The image is cut into horizontal bands. Each band is processed with
+   a halo of the rows above and below it that the structuring element
+   reaches, so the band comes out exactly as it would from the serial
+   function, and the bands can go on separate threads (see parallel.c).
+
+   By Malcolm McLean.
+*/
+#include <stdlib.h>
+#include <string.h>
+
+#include "binaryutils.h"
+#include "parallel.h"
+#include "tiledmorph.h"
+
+#define OP_DILATE 0
+#define OP_ERODE 1
+#define OP_OPEN 2
+#define OP_CLOSE 3
+
+typedef struct
+{
+  unsigned char *binary;  /* the image */
+  int width;              /* image width */
+  int height;             /* image height */
+  unsigned char *sel;     /* structuring element */
+  int swidth;             /* structuring element width */
+  int sheight;            /* structuring element height */
+  int op;                 /* which operation */
+  int bandheight;         /* rows per band */
+  int top;                /* halo rows needed above a band */
+  int bottom;             /* halo rows needed below a band */
+  unsigned char *halos;   /* saved halo rows, top then bottom, per band */
+  int *errors;            /* error return per band */
+} TILEDMORPH;
+
+static int tiledmorph(unsigned char *binary, int width, int height, unsigned char *sel, int swidth, int sheight,
+                      int op, int Nthreads);
+static void savehalos(void *ptr, int band);
+static void processband(void *ptr, int band);
+static int serialop(unsigned char *binary, int width, int height, unsigned char *sel, int swidth, int sheight, int op);
+
+/**
+  Multithreaded dilate.
+
+  @param[in,out] binary - the binary image
+  @param width - image width
+  @param height - image height
+  @param[in] sel - the selection element
+  @param swidth - selection element width
+  @param sheight - selection element height
+  @param Nthreads - number of threads to use
+  @returns 0 on success, -1 on error.
+  @note Result is identical to dilate().
+*/
+int dilate_mt(unsigned char *binary, int width, int height, unsigned char *sel, int swidth, int sheight, int Nthreads)
+{
+  return tiledmorph(binary, width, height, sel, swidth, sheight, OP_DILATE, Nthreads);
+}
+
+/**
+  Multithreaded erode.
+
+  @param[in,out] binary - the binary image
+  @param width - image width
+  @param height - image height
+  @param[in] sel - the selection element
+  @param swidth - selection element width
+  @param sheight - selection element height
+  @param Nthreads - number of threads to use
+  @returns 0 on success, -1 on error.
+  @note Result is identical to erode().
+*/
+int erode_mt(unsigned char *binary, int width, int height, unsigned char *sel, int swidth, int sheight, int Nthreads)
+{
+  return tiledmorph(binary, width, height, sel, swidth, sheight, OP_ERODE, Nthreads);
+}
+
+/**
+  Multithreaded morphological open.
+
+  @param[in,out] binary - the binary image
+  @param width - image width
+  @param height - image height
+  @param[in] sel - the selection element
+  @param swidth - selection element width
+  @param sheight - selection element height
+  @param Nthreads - number of threads to use
+  @returns 0 on success, -1 on error.
+  @note Result is identical to morphopen().
+*/
+int morphopen_mt(unsigned char *binary, int width, int height, unsigned char *sel, int swidth, int sheight, int Nthreads)
+{
+  return tiledmorph(binary, width, height, sel, swidth, sheight, OP_OPEN, Nthreads);
+}
+
+/**
+  Multithreaded morphological close.
+
+  @param[in,out] binary - the binary image
+  @param width - image width
+  @param height - image height
+  @param[in] sel - the selection element
+  @param swidth - selection element width
+  @param sheight - selection element height
+  @param Nthreads - number of threads to use
+  @returns 0 on success, -1 on error.
+  @note Result is identical to morphclose().
+*/
+int morphclose_mt(unsigned char *binary, int width, int height, unsigned char *sel, int swidth, int sheight, int Nthreads)
+{
+  return tiledmorph(binary, width, height, sel, swidth, sheight, OP_CLOSE, Nthreads);
+}
+
+/*
+  Run a morphological operation band by band.
+  Params: binary - the binary image
+          width - image width
+          height - image height
+          sel - the structuring element
+          swidth - structuring element width
+          sheight - structuring element height
+          op - the operation
+          Nthreads - number of threads
+  Returns: 0 on success, -1 on out of memory.
+  Notes: there are two rounds. First every band saves the halo rows it
+         needs, which belong to its neighbours and will be overwritten.
+         Then every band copies itself plus its halos to a private
+         buffer, runs the serial operation, and writes its own rows back.
+*/
+static int tiledmorph(unsigned char *binary, int width, int height, unsigned char *sel, int swidth, int sheight,
+                      int op, int Nthreads)
+{
+  TILEDMORPH tm;
+  int passes;
+  int Nbands;
+  int i;
+  int answer = 0;
+
+  if(Nthreads <= 1 || height < 2)
+    return serialop(binary, width, height, sel, swidth, sheight, op);
+
+  passes = (op == OP_OPEN || op == OP_CLOSE) ? 2 : 1;
+  tm.binary = binary;
+  tm.width = width;
+  tm.height = height;
+  tm.sel = sel;
+  tm.swidth = swidth;
+  tm.sheight = sheight;
+  tm.op = op;
+  tm.top = passes * (sheight/2);
+  tm.bottom = passes * (sheight - 1 - sheight/2);
+  /* two bands per thread for load balancing, but not all halo */
+  tm.bandheight = (height + 2 * Nthreads - 1) / (2 * Nthreads);
+  if(tm.bandheight < tm.top + tm.bottom + 1)
+    tm.bandheight = tm.top + tm.bottom + 1;
+  Nbands = (height + tm.bandheight - 1) / tm.bandheight;
+
+  tm.halos = malloc((size_t) Nbands * (tm.top + tm.bottom) * width + 1);
+  tm.errors = malloc(Nbands * sizeof(int));
+  if(!tm.halos || !tm.errors)
+  {
+    free(tm.halos);
+    free(tm.errors);
+    return -1;
+  }
+
+  parallel_for(Nbands, Nthreads, savehalos, &tm);
+  parallel_for(Nbands, Nthreads, processband, &tm);
+
+  for(i=0;i<Nbands;i++)
+    if(tm.errors[i])
+      answer = -1;
+
+  free(tm.halos);
+  free(tm.errors);
+  return answer;
+}
+
+/*
+  first round, save the halo rows of a band.
+*/
+static void savehalos(void *ptr, int band)
+{
+  TILEDMORPH *tm = ptr;
+  unsigned char *halo;
+  int y0, y1;
+  int ytop, ybottom;
+
+  halo = tm->halos + (size_t) band * (tm->top + tm->bottom) * tm->width;
+  y0 = band * tm->bandheight;
+  y1 = y0 + tm->bandheight < tm->height ? y0 + tm->bandheight : tm->height;
+  ytop = y0 - tm->top > 0 ? y0 - tm->top : 0;
+  ybottom = y1 + tm->bottom < tm->height ? y1 + tm->bottom : tm->height;
+
+  memcpy(halo, tm->binary + (size_t) ytop * tm->width, (size_t) (y0 - ytop) * tm->width);
+  halo += (size_t) tm->top * tm->width;
+  memcpy(halo, tm->binary + (size_t) y1 * tm->width, (size_t) (ybottom - y1) * tm->width);
+}
+
+/*
+  second round, process a band with its halos and write it back.
+*/
+static void processband(void *ptr, int band)
+{
+  TILEDMORPH *tm = ptr;
+  unsigned char *halo;
+  unsigned char *buff;
+  int y0, y1;
+  int ytop, ybottom;
+  int Ntop, Nrows, Nbottom;
+
+  halo = tm->halos + (size_t) band * (tm->top + tm->bottom) * tm->width;
+  y0 = band * tm->bandheight;
+  y1 = y0 + tm->bandheight < tm->height ? y0 + tm->bandheight : tm->height;
+  ytop = y0 - tm->top > 0 ? y0 - tm->top : 0;
+  ybottom = y1 + tm->bottom < tm->height ? y1 + tm->bottom : tm->height;
+  Ntop = y0 - ytop;
+  Nrows = y1 - y0;
+  Nbottom = ybottom - y1;
+
+  buff = malloc((size_t) (Ntop + Nrows + Nbottom) * tm->width);
+  if(!buff)
+  {
+    tm->errors[band] = -1;
+    return;
+  }
+  memcpy(buff, halo, (size_t) Ntop * tm->width);
+  memcpy(buff + (size_t) Ntop * tm->width, tm->binary + (size_t) y0 * tm->width, (size_t) Nrows * tm->width);
+  memcpy(buff + (size_t) (Ntop + Nrows) * tm->width, halo + (size_t) tm->top * tm->width,
+         (size_t) Nbottom * tm->width);
+
+  tm->errors[band] = serialop(buff, tm->width, Ntop + Nrows + Nbottom, tm->sel, tm->swidth, tm->sheight, tm->op);
+  if(tm->errors[band] == 0)
+    memcpy(tm->binary + (size_t) y0 * tm->width, buff + (size_t) Ntop * tm->width, (size_t) Nrows * tm->width);
+
+  free(buff);
+}
+
+/*
+  the single-threaded operation
+*/
+static int serialop(unsigned char *binary, int width, int height, unsigned char *sel, int swidth, int sheight, int op)
+{
+  switch(op)
+  {
+    case OP_DILATE: return dilate(binary, width, height, sel, swidth, sheight);
+    case OP_ERODE: return erode(binary, width, height, sel, swidth, sheight);
+    case OP_OPEN: return morphopen(binary, width, height, sel, swidth, sheight);
+    case OP_CLOSE: return morphclose(binary, width, height, sel, swidth, sheight);
+  }
+  return -1;
+}
@@ -0,0 +1,9 @@
+#ifndef tiledmorph_h
+#define tiledmorph_h
+
+int dilate_mt(unsigned char *binary, int width, int height, unsigned char *sel, int swidth, int sheight, int Nthreads);
+int erode_mt(unsigned char *binary, int width, int height, unsigned char *sel, int swidth, int sheight, int Nthreads);
+int morphopen_mt(unsigned char *binary, int width, int height, unsigned char *sel, int swidth, int sheight, int Nthreads);
+int morphclose_mt(unsigned char *binary, int width, int height, unsigned char *sel, int swidth, int sheight, int Nthreads);
+
+#endif
@@ -10,9 +10,10 @@
 #include <stdlib.h>
 #include <math.h>
 
+#include "distancetransform.h"
+
 static int compcells(const void *e1, const void *e2);
 static void get3x3(int *out, int *binary, int width, int height, int x, int y, int border);
-static int *edt_saito(unsigned char *binary, int width, int height);
 
 typedef struct
 {
@@ -39,6 +40,7 @@ typedef struct
 int discrete_voronoi(int *seeds, int width, int height)
 {
 	unsigned char *binary = 0;
+	DTOPTIONS opt;
 	int *edt = 0;
 	CELL *cells = 0;
 	int neighbours[9];
@@ -53,10 +55,16 @@ int discrete_voronoi(int *seeds, int width, int height)
 	for (i = 0; i < width*height; i++)
 		binary[i] = (seeds[i] == -1) ? 1 : 0;
 
-	edt = edt_saito(binary, width, height);
+	opt.metric = DT_EUCLIDEAN;
+	opt.output = DT_INT;
+	opt.border = DT_BORDER_IGNORE;
+	opt.Nthreads = 1;
+	edt = distancetransform(binary, width, height, &opt);
 	if (!edt)
 		goto error_exit;
 	cells = malloc(width * height * sizeof(CELL));
+	if (!cells)
+		goto error_exit;
 
 	int x, y;
 	for (y = 0; y < height; y++)
@@ -141,164 +149,3 @@ static void get3x3(int *out, int *binary, int width, int height, int x, int y, i
 	if (y < height - 1)          out[7] = binary[(y + 1)*width + x];   else out[7] = border;
 	if (y < height - 1 && x < width - 1) out[8] = binary[(y + 1)*width + x + 1]; else out[8] = border;
 }
-/*
-* Final implementation by R. Fabbri,
-* based on two independent implementations by O. Cuisenaire
-* and J. C. Torelli.
-*
-* PAPER
-*    T. Saito and J.I. Toriwaki, "New algorithms for Euclidean distance
-*    transformations of an n-dimensional digitised picture with applications",
-*    Pattern Recognition, 27(11), pp. 1551-1565, 1994
-*
-* A nice overview of Saito's method may be found at:
-*    Chapter 2 of "Distance transformations: fast algorithms and applications
-*    to medical image processing", Olivier Cuisenaire's Ph.D. Thesis, October
-*    1999, Universit catholique de Louvain, Belgium.
-*
-*
-*/
-static int *edt_saito(unsigned char *binary, int width, int height)
-{
-	int i, j, l, a, b, m, buffer, nsqr, diag1,
-		*ptstart, *ptend, *sq, *df2, *buff, *pt, *npt;
-
-	int *map = 0;
-	sq = 0;
-	buff = 0;
-
-
-	map = malloc(width * height * sizeof(int));
-	if (!map)
-		goto error_exit;
-	for (i = 0; i<width*height; i++)
-		map[i] = binary[i];
-
-
-	/* this is >= the diagonal minus 1 */
-	diag1 = (int)ceil(sqrt((width - 1)*(width - 1) + (height - 1)*(height - 1))) - 1;
-
-	/* Cuisenaire's idea: a LUT with precomputed i*i */
-	nsqr = 2 * (diag1 + 1);   /* was: 2*r + 2 in Cuisenaire's code */
-	sq = malloc(nsqr * sizeof(int));
-	if (!sq)
-		goto error_exit;
-	for (i = 0; i<nsqr; i++)
-		sq[i] = i*i;
-
-	/* buff stores the current column in step 2 */
-	buff = malloc(height * sizeof(int));
-	if (!buff)
-		goto error_exit;
-
-	/*-- Step 1 --*/
-	for (j = 0; j<height; j++)
-	{
-		ptstart = map + j*width;
-		ptend = ptstart + width;
-
-		/* forward scan */
-		df2 = sq + diag1;  /* the paper: df2 = sq + r, not large enough */
-		for (pt = ptstart; pt < ptend; pt++)
-			if (*pt)
-				*pt = *(++df2);
-			else
-				df2 = sq;
-
-		/* backward scan */
-		df2 = sq + diag1;  /* the paper: df2 = sq + r, not large enough */
-		for (--pt; pt != ptstart - 1; --pt)
-			if (*pt)
-			{
-				if (*pt > *(++df2))
-					*pt = *df2;
-			}
-			else
-				df2 = sq;
-	}
-
-
-	/*-- Step 2 --*/
-
-	for (i = 0; i<width; i++)
-	{
-		pt = map + i;
-
-		for (j = 0; j<height; j++, pt += width)
-			buff[j] = *pt;
-
-		pt = map + i + width;
-		a = 0;
-		buffer = buff[0];
-		for (j = 1; j < height; j++, pt += width)
-		{
-			if (a != 0)
-				--a;
-			if (buff[j] > buffer + 1)
-			{
-				b = (buff[j] - buffer - 1) / 2;
-				if (j + b + 1 > height)
-					b = height - 1 - j;
-
-				npt = pt + a*width;
-				for (l = a; l <= b; l++)
-				{
-					m = buffer + sq[l + 1];
-					if (buff[j + l] <= m)
-						break;   /* go to next column j */
-					if (m < *npt)
-						*npt = m;
-					npt += width;
-				}
-				a = b;
-			}
-			else
-				a = 0;
-			buffer = buff[j];
-		}
-
-
-		a = 0;
-		pt -= 2 * width;
-		buffer = buff[height - 1];
-
-		for (j = height - 2; j != -1; j--, pt -= width)
-		{
-			if (a != 0)
-				--a;
-			if (buff[j] > buffer + 1)
-			{
-				b = (buff[j] - buffer - 1) / 2;
-				if (j < b)
-					b = j;
-
-				npt = pt - a*width;
-				for (l = a; l <= b; ++l)
-				{
-					m = buffer + sq[l + 1];
-					if (buff[j - l] <= m)
-						break;   /* go to next column j */
-					if (m < *npt)
-						*npt = m;
-					npt -= width;
-				}
-				a = b;
-			}
-			else
-				a = 0;
-			buffer = buff[j];
-		}
-
-	}
-
-	free(sq);
-	free(buff);
-
-	return map;
-
-error_exit:
-	free(buff);
-	free(sq);
-	free(map);
-	return 0;
-}
\ No newline at end of file